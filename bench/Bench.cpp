@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2019 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Measures the overhead of DeepState's own runtime: how many test executions
+ * per second each execution mode manages, how long each execution takes, and
+ * how much memory the process uses, on small tests modeled after the
+ * `Primes`, `Runlen` and `OneOf` examples.
+ *
+ * Every test is benchmarked in every mode in a fresh process, and the results
+ * are logged and written to a JSON file, so that changes to the runtime's hot
+ * path can be compared release over release. */
+
+#include <deepstate/DeepState.hpp>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace deepstate;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+DEFINE_uint(bench_execs, ExecutionGroup, 2000,
+            "Number of executions of each test in each benchmarked mode.");
+
+DEFINE_uint(bench_input_bytes, ExecutionGroup, 64,
+            "Size of the inputs that benchmarked tests run on.");
+
+DEFINE_string(bench_modes, ExecutionGroup,
+              "fork,fork_server,no_fork,replay,libfuzzer,fuzz",
+              "Comma-separated list of execution modes to benchmark.");
+
+DEFINE_string(bench_output, InputOutputGroup, "deepstate_bench.json",
+              "File to write the benchmark results to, as JSON.");
+
+/* The tests. They are meant to pass on every input, so that the benchmark
+ * measures the common path of a run, and to free what they allocate, so that
+ * memory use reflects the runtime and not the tests. */
+
+static bool IsPrime(const unsigned p) {
+  for (unsigned i = 2; i <= (p/2); ++i) {
+    if (!(p % i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TEST(Bench, Primes) {
+  unsigned x = DeepState_UIntInRange(0, 39);
+  unsigned poly = (x * x) + x + 41;
+  ASSERT(IsPrime(poly))
+      << x << "^2 + " << x << " + 41 is not prime";
+}
+
+static std::string Encode(const std::string &input) {
+  std::string encoded;
+  for (size_t i = 0; i < input.size(); ) {
+    size_t count = 1;
+    while (i + count < input.size() && input[i + count] == input[i] &&
+           count < 26) {
+      count++;
+    }
+    encoded += input[i];
+    encoded += static_cast<char>(64 + count);
+    i += count;
+  }
+  return encoded;
+}
+
+static std::string Decode(const std::string &encoded) {
+  std::string decoded;
+  for (size_t i = 0; i + 1 < encoded.size(); i += 2) {
+    decoded.append(static_cast<size_t>(encoded[i + 1] - 64), encoded[i]);
+  }
+  return decoded;
+}
+
+TEST(Bench, RunLength) {
+  std::string original = DeepState_CStrUpToLen(32, "abc");
+  std::string encoded = Encode(original);
+  ASSERT_LE(encoded.size(), original.size() * 2)
+      << "Encoding is > length*2!";
+  ASSERT(Decode(encoded) == original)
+      << "ORIGINAL: '" << original << "', ENCODED: '" << encoded << "'";
+}
+
+TEST(Bench, OneOfSteps) {
+  int x = DeepState_IntInRange(-5, 5);
+  for (int n = 0; n < 16; n++) {
+    OneOf(
+      [&] { x += 1; },
+      [&] { x -= 1; },
+      [&] { x *= 2; },
+      [&] { x += 10; },
+      [&] { x = 0; });
+  }
+  ASSERT_LE(x, 15 << 16) << x << " grew too fast";
+}
+
+/* The benchmarked execution modes. */
+enum BenchMode {
+  kBenchFork,        /* Default test runs, each in a forked process. */
+  kBenchForkServer,  /* `--fork_server`. */
+  kBenchNoFork,      /* `--no_fork`. */
+  kBenchReplay,      /* `--input_test_dir`, with `--no_fork`. */
+  kBenchLibFuzzer,   /* `LLVMFuzzerTestOneInput`. */
+  kBenchFuzz,        /* `--fuzz`, with `--no_fork`. */
+  kNumBenchModes
+};
+
+static const char * const kBenchModeNames[kNumBenchModes] = {
+  "fork",
+  "fork_server",
+  "no_fork",
+  "replay",
+  "libfuzzer",
+  "fuzz",
+};
+
+/* What a benchmarking process reports back, in memory shared with the parent
+ * process. It is followed by the latency of every execution. */
+struct BenchRun {
+  uint32_t num_execs;
+  uint32_t num_failed;
+  uint32_t num_abandoned;
+  uint32_t unused;  /* Keeps the latencies aligned. */
+};
+
+static uint64_t *BenchLatencies(BenchRun *run) {
+  return reinterpret_cast<uint64_t *>(run + 1);
+}
+
+/* Log a fatal setup error outside of any test, and give up. */
+static void BenchError(const char *message) {
+  DeepState_LogFormat(DeepState_LogError, "%s", message);
+  exit(1);
+}
+
+/* The inputs that tests run on, in memory and as saved test cases. */
+static std::vector<std::vector<uint8_t>> gInputs;
+static std::vector<std::string> gInputNames;
+static char gInputDir[] = "/tmp/deepstate_bench.XXXXXX";
+
+static const unsigned kNumInputs = 256;
+
+static uint64_t NowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+/* Make `kNumInputs` random inputs, and save them as test cases. */
+static void MakeInputs(void) {
+  if (!mkdtemp(gInputDir)) {
+    BenchError("Unable to create a directory for benchmark inputs");
+  }
+
+  uint64_t state = HAS_FLAG_seed ? FLAGS_seed : 0;
+  for (unsigned i = 0; i < kNumInputs; i++) {
+    std::vector<uint8_t> input(FLAGS_bench_input_bytes);
+    for (auto &byte : input) {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+      byte = static_cast<uint8_t>(state >> 56);
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "%04u.pass", i);
+    std::string path = std::string(gInputDir) + "/" + name;
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp || fwrite(input.data(), 1, input.size(), fp) != input.size()) {
+      BenchError("Unable to write benchmark input");
+    }
+    fclose(fp);
+
+    gInputs.push_back(input);
+    gInputNames.push_back(name);
+  }
+}
+
+static void RemoveInputs(void) {
+  for (const auto &name : gInputNames) {
+    unlink((std::string(gInputDir) + "/" + name).c_str());
+  }
+  rmdir(gInputDir);
+}
+
+/* Run `test` `FLAGS_bench_execs` times in `mode`, timing every execution.
+ * This runs in its own process. */
+static void RunBenchmark(struct DeepState_TestInfo *test, BenchMode mode,
+                         BenchRun *run) {
+  FLAGS_fork = mode == kBenchFork || mode == kBenchForkServer;
+  FLAGS_fork_server = mode == kBenchForkServer;
+  if (mode == kBenchLibFuzzer) {
+    setenv("LIBFUZZER_WHICH_TEST", test->test_name, 1);
+
+    /* The first call sets up the entry point, so it isn't timed. */
+    LLVMFuzzerTestOneInput(gInputs[0].data(), gInputs[0].size());
+  }
+
+  uint64_t *latencies = BenchLatencies(run);
+  for (uint32_t i = 0; i < FLAGS_bench_execs; i++) {
+    const std::vector<uint8_t> &input = gInputs[i % gInputs.size()];
+    enum DeepState_TestRunResult result = DeepState_TestRunPass;
+
+    /* Loading the input is what a harness would have done before running
+     * the test, so it isn't timed. */
+    if (mode == kBenchFork || mode == kBenchForkServer ||
+        mode == kBenchNoFork) {
+      DeepState_InputIndex = 0;
+      DeepState_SwarmConfigsIndex = 0;
+      DeepState_InputGenerated = DeepState_InputSize;
+      memcpy((void *) DeepState_Input, input.data(), input.size());
+      DeepState_ClearInputFrom(input.size());
+      DeepState_SetInputEnd(input.size());
+    }
+
+    uint64_t begin = NowNs();
+    switch (mode) {
+      case kBenchFork:
+      case kBenchForkServer:
+      case kBenchNoFork:
+        DeepState_Begin(test);
+        result = DeepState_ForkAndRunTest(test);
+        break;
+      case kBenchReplay:
+        result = DeepState_RunSavedTestCase(
+            test, gInputDir, gInputNames[i % gInputNames.size()].c_str());
+        break;
+      case kBenchLibFuzzer:
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+        if (DeepState_CatchFail()) {
+          result = DeepState_TestRunFail;
+        } else if (DeepState_CatchAbandoned()) {
+          result = DeepState_TestRunAbandon;
+        }
+        break;
+      case kBenchFuzz:
+        result = DeepState_FuzzOneTestCase(test);
+        break;
+      default:
+        break;
+    }
+    latencies[i] = NowNs() - begin;
+
+    run->num_execs++;
+    if (result == DeepState_TestRunAbandon) {
+      run->num_abandoned++;
+    } else if (result != DeepState_TestRunPass) {
+      run->num_failed++;
+    }
+  }
+
+  DeepState_Teardown();
+}
+
+/* Benchmark `test` in `mode` in a fresh process, then log the results and
+ * append them to `json`. Returns `false` if the benchmark didn't finish. */
+static bool Benchmark(struct DeepState_TestInfo *test, BenchMode mode,
+                      std::string &json) {
+  size_t run_size = sizeof(BenchRun) + FLAGS_bench_execs * sizeof(uint64_t);
+  void *mem = mmap(NULL, run_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    BenchError("Unable to map memory for benchmark results");
+  }
+  BenchRun *run = new (mem) BenchRun();
+
+  pid_t pid = fork();
+  if (!pid) {
+    RunBenchmark(test, mode, run);
+    _exit(0);
+  } else if (pid < 0) {
+    BenchError("Unable to fork a benchmark process");
+  }
+
+  int wstatus = 0;
+  struct rusage usage = {};
+  wait4(pid, &wstatus, 0, &usage);
+
+  bool finished = WIFEXITED(wstatus) && !WEXITSTATUS(wstatus) &&
+                  run->num_execs == FLAGS_bench_execs;
+  if (!finished) {
+    DeepState_LogFormat(DeepState_LogError,
+                        "Benchmark of %s in %s mode stopped after %u executions",
+                        test->test_name, kBenchModeNames[mode], run->num_execs);
+  } else if (run->num_execs) {
+    std::vector<uint64_t> latencies(BenchLatencies(run),
+                                    BenchLatencies(run) + run->num_execs);
+    std::sort(latencies.begin(), latencies.end());
+
+    uint64_t total_ns = 0;
+    for (auto ns : latencies) {
+      total_ns += ns;
+    }
+    double execs_per_sec =
+        total_ns ? run->num_execs * 1e9 / static_cast<double>(total_ns) : 0;
+    auto percentile = [&](unsigned p) {
+      return latencies[(latencies.size() - 1) * p / 100];
+    };
+
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "%-18s %-12s %12.0f execs/s  p50 %9.2f us  p90 %9.2f us  "
+             "p99 %9.2f us  max RSS %ld KB",
+             test->test_name, kBenchModeNames[mode], execs_per_sec,
+             percentile(50) / 1e3, percentile(90) / 1e3, percentile(99) / 1e3,
+             usage.ru_maxrss);
+    DeepState_Log(DeepState_LogInfo, buf);
+
+    snprintf(buf, sizeof(buf),
+             "%s    {\"test\": \"%s\", \"mode\": \"%s\", \"execs\": %u, "
+             "\"failed\": %u, \"abandoned\": %u, \"execs_per_sec\": %.1f, "
+             "\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, "
+             "\"max_rss_kb\": %ld}",
+             json.empty() ? "" : ",\n", test->test_name,
+             kBenchModeNames[mode], run->num_execs, run->num_failed,
+             run->num_abandoned, execs_per_sec,
+             static_cast<unsigned long long>(percentile(50)),
+             static_cast<unsigned long long>(percentile(90)),
+             static_cast<unsigned long long>(percentile(99)),
+             usage.ru_maxrss);
+    json += buf;
+  }
+
+  munmap(mem, run_size);
+  return finished;
+}
+
+/* Returns `true` if `mode` is in the comma-separated `--bench_modes`. */
+static bool ModeIsSelected(BenchMode mode) {
+  std::string modes = std::string(",") + FLAGS_bench_modes + ",";
+  std::string name = std::string(",") + kBenchModeNames[mode] + ",";
+  return modes.find(name) != std::string::npos;
+}
+
+int main(int argc, char *argv[]) {
+  DeepState_Setup();
+  DeepState_InitOptions(argc, argv);
+
+  if (!HAS_FLAG_min_log_level) {
+    FLAGS_min_log_level = DeepState_LogInfo;
+  }
+  if (HAS_FLAG_max_input_size) {
+    DeepState_SetInputSize(FLAGS_max_input_size);
+  }
+  if (FLAGS_bench_input_bytes > DeepState_InputSize) {
+    BenchError("--bench_input_bytes is larger than the input buffer");
+  }
+
+  MakeInputs();
+
+  int num_unfinished = 0;
+  std::string json;
+  for (struct DeepState_TestInfo *test = DeepState_FirstTest(); test != NULL;
+       test = test->prev) {
+    if (HAS_FLAG_test_filter &&
+        fnmatch(FLAGS_test_filter, test->test_name, FNM_NOESCAPE)) {
+      continue;
+    }
+    for (int mode = 0; mode < kNumBenchModes; mode++) {
+      if (ModeIsSelected(static_cast<BenchMode>(mode)) &&
+          !Benchmark(test, static_cast<BenchMode>(mode), json)) {
+        num_unfinished++;
+      }
+    }
+  }
+
+  RemoveInputs();
+
+  char header[256];
+  snprintf(header, sizeof(header),
+           "{\n  \"execs\": %u,\n  \"input_bytes\": %u,\n"
+           "  \"input_size\": %u,\n  \"results\": [\n",
+           FLAGS_bench_execs, FLAGS_bench_input_bytes, DeepState_InputSize);
+
+  FILE *fp = fopen(FLAGS_bench_output, "w");
+  if (!fp) {
+    DeepState_LogFormat(DeepState_LogError, "Unable to write %s",
+                        FLAGS_bench_output);
+    return 1;
+  }
+  fputs(header, fp);
+  fputs(json.c_str(), fp);
+  fputs("\n  ]\n}\n", fp);
+  fclose(fp);
+
+  DeepState_LogFormat(DeepState_LogInfo, "Wrote benchmark results to %s",
+                      FLAGS_bench_output);
+
+  DeepState_Teardown();
+  return num_unfinished;
+}
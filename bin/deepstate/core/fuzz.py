@@ -549,6 +549,11 @@ class FuzzerFrontend(AnalysisBackend):
       "--min_log_level", str(self.min_log_level)
     ])
 
+    # let the harness read inputs as large as the fuzzer generates
+    # (0 means unlimited for the fuzzer; the harness keeps its default)
+    if self.max_input_size > 0:
+      cmd_list.extend(["--max_input_size", str(self.max_input_size)])
+
     # append any other DeepState flags
     for key, val in self.target_args:
       if len(key) == 1:
@@ -18,10 +18,46 @@ import argparse
 import subprocess
 import os
 import re
+import struct
 import sys
 import time
 
 
+# Layout of the binary trace written by `--trace_reads`; see
+# `DeepState_TraceHeader` and `DeepState_TraceEntry` in DeepState.h.
+TRACE_MAGIC = 0x52545344
+TRACE_HEADER = struct.Struct("=IIQ")
+TRACE_ENTRY = struct.Struct("=HHIIIq")
+TRACE_READ = 1
+TRACE_ONEOF_BEGIN = 2
+TRACE_ONEOF_END = 3
+TRACE_RANGE_CONVERSION = 4
+
+
+def readTrace(path):
+  """Returns the (event, offset, size, value) entries of a `--trace_reads`
+  trace file, oldest first, or an empty list if there is no trace."""
+  try:
+    with open(path, 'rb') as inf:
+      data = inf.read()
+  except IOError:
+    return []
+  if len(data) < TRACE_HEADER.size:
+    return []
+  (magic, capacity, count) = TRACE_HEADER.unpack_from(data, 0)
+  if (magic != TRACE_MAGIC) or (capacity == 0):
+    return []
+  first = max(0, count - capacity)
+  entries = []
+  for i in range(first, count):
+    pos = TRACE_HEADER.size + (i % capacity) * TRACE_ENTRY.size
+    if pos + TRACE_ENTRY.size > len(data):
+      break
+    (event, _, offset, size, _, value) = TRACE_ENTRY.unpack_from(data, pos)
+    entries.append((event, offset, size, value))
+  return entries
+
+
 def main():
   global candidateRuns, currentTest, s, passStart
 
@@ -46,7 +82,7 @@ def main():
     default=None)
   parser.add_argument("--andCriteria", action="store_true", help="AND criteria instead of ORing them")
   parser.add_argument(
-    "--cmdArgs", type=str, help="Command line to use in place of standard DeepState arguments, file replaces @@")
+    "--cmdArgs", type=str, help="Command line to use in place of standard DeepState arguments, file replaces @@ (--trace_reads is still added)")
   parser.add_argument(
     "--candidateName", type=str, help="Candidate name to use in place of default")
   parser.add_argument(
@@ -106,32 +142,37 @@ def main():
   if args.candidateName is not None:
     candidateName = args.candidateName
 
+  traceName = ".reducer." + str(os.getpid()) + ".trace"
+
   def runCandidate(candidate):
     global candidateRuns
 
     candidateRuns += 1
     if (time.time() - start) > args.timeout:
       raise TimeoutException
+    if os.path.exists(traceName):
+      os.remove(traceName)
     with open(".reducer." + str(os.getpid()) + ".out", 'w') as outf:
       if args.cmdArgs is None:
         cmd = [deepstate + " --input_test_file " +
-             candidate + " --verbose_reads"]
+             candidate + " --trace_reads " + traceName]
         if whichTest is not None:
           cmd += ["--input_which_test", whichTest]
         if not args.fork:
           cmd += ["--no_fork"]
       else:
-        cmd = [deepstate + " " + args.cmdArgs.replace("@@", candidate)]
+        cmd = [deepstate + " " + args.cmdArgs.replace("@@", candidate) +
+               " --trace_reads " + traceName]
       exitCode = subprocess.call(cmd, shell=True, stdout=outf, stderr=outf)
     result = []
     with open(".reducer." + str(os.getpid()) + ".out", 'rb') as inf:
       for line in inf:
         dline = line.decode("utf-8", "ignore")
         result.append(dline)
-    return (result, exitCode)
+    return (result, exitCode, readTrace(traceName))
 
   def checks(resultAndExitCode):
-    (result, exitCode) = resultAndExitCode
+    (result, exitCode, _) = resultAndExitCode
     if (args.exitCriterion is None) and (checkRegExp is None) and (checkString is None):
       # Only apply default DeepState failure check if no other criteria were defined
       for line in result:
@@ -211,43 +252,34 @@ def main():
     return (OneOfs + delims, lastRead)
 
   def structure(resultAndExitCode):
-    (result, exitCode) = resultAndExitCode
+    (result, exitCode, trace) = resultAndExitCode
     lastRead = len(currentTest) - 1
     if args.noStructure:
       return ([], lastRead)
     OneOfs = []
     currentOneOf = []
-    for line in result:
-      if "STARTING OneOf CALL" in line:
+    for (event, offset, size, value) in trace:
+      if event == TRACE_ONEOF_BEGIN:
         currentOneOf.append(-1)
-      elif "Reading byte at" in line:
-        lastRead = int(line.split()[-1])
+      elif (event == TRACE_READ) and (size > 0):
+        lastRead = offset + size - 1
         if len(currentOneOf) > 0:
           if currentOneOf[-1] == -1:
-            currentOneOf[-1] = lastRead
-      elif "FINISHED OneOf CALL" in line:
+            currentOneOf[-1] = offset
+      elif (event == TRACE_ONEOF_END) and (len(currentOneOf) > 0):
         OneOfs.append((currentOneOf[-1], lastRead))
         currentOneOf = currentOneOf[:-1]
     return (OneOfs, lastRead)
 
   def rangeConversions(resultAndExitCode):
-    (result, exitCode) = resultAndExitCode
+    (result, exitCode, trace) = resultAndExitCode
     conversions = []
-    startedMulti = False
-    multiFirst = None
-    for line in result:
-      if "Reading byte at" in line:
-        lastRead = int(line.split()[-1])
-      if "STARTING MULTI-BYTE READ" in line:
-        startedMulti = True
-      if startedMulti and (multiFirst is None) and ("Reading byte at" in line):
-        multiFirst = lastRead
-      if "FINISHED MULTI-BYTE READ" in line:
-        currentMulti = (multiFirst, lastRead)
-        startedMulti = False
-        multiFirst = None
-      if "Converting out-of-range value" in line:
-        conversions.append((currentMulti, int(line.split()[-1])))
+    lastMulti = None
+    for (event, offset, size, value) in trace:
+      if (event == TRACE_READ) and (size > 0):
+        lastMulti = (offset, offset + size - 1)
+      elif (event == TRACE_RANGE_CONVERSION) and (lastMulti is not None):
+        conversions.append((lastMulti, value))
     return conversions
 
   def fixRangeConversions(test, conversions):
@@ -622,6 +654,9 @@ def main():
   with open(out, 'wb') as outf:
     outf.write(currentTest)
 
+  if os.path.exists(traceName):
+    os.remove(traceName)
+
   return 0
 
 if "__main__" == __name__:
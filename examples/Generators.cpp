@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2019 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <deepstate/DeepState.hpp>
+#include <deepstate/Gen.hpp>
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace deepstate;
+namespace gen = deepstate::gen;
+
+enum class Op { Add, Sub, Mul };
+
+struct Instr {
+  Op op;
+  int arg;
+};
+
+static int Eval(const std::vector<Instr> &program) {
+  int acc = 0;
+  for (const Instr &instr : program) {
+    switch (instr.op) {
+      case Op::Add: acc += instr.arg; break;
+      case Op::Sub: acc -= instr.arg; break;
+      case Op::Mul: acc *= instr.arg; break;
+    }
+  }
+  return acc;
+}
+
+static std::string Show(const std::vector<Instr> &program) {
+  static const char *names[] = {"add", "sub", "mul"};
+  std::stringstream ss;
+  for (const Instr &instr : program) {
+    ss << " " << names[static_cast<int>(instr.op)] << " " << instr.arg;
+  }
+  return ss.str();
+}
+
+// Programs are drawn instruction by instruction, each an `Op` and then its
+// argument, so a failure only replays if `Construct` keeps that order.
+TEST(Generators, Program) {
+  auto instr = gen::Construct<Instr>(gen::Enum(Op::Add, Op::Mul),
+                                     gen::InRange(-9, 9));
+  std::vector<Instr> program = gen::VectorOf(instr, 1, 6)();
+
+  ASSERT(program.size() >= 1 && program.size() <= 6)
+      << "bad size " << program.size();
+  for (const Instr &i : program) {
+    ASSERT(i.arg >= -9 && i.arg <= 9) << "bad argument " << i.arg;
+  }
+  ASSERT_NE(Eval(program), 42) << "program:" << Show(program);
+}
+
+TEST(Generators, Tuple) {
+  auto values = gen::Tuple(gen::InRange(0, 9),
+                                 gen::Element('a', 'b', 'c'),
+                                 gen::Just(7),
+                                 gen::Map(gen::InRange(0u, 3u),
+                                          [] (unsigned x) { return x * x; }));
+  std::tuple<int, char, int, unsigned> t = values();
+
+  ASSERT(std::get<0>(t) >= 0 && std::get<0>(t) <= 9);
+  ASSERT(std::get<1>(t) >= 'a' && std::get<1>(t) <= 'c');
+  ASSERT_EQ(std::get<2>(t), 7);
+  ASSERT(std::get<3>(t) == 0 || std::get<3>(t) == 1 ||
+         std::get<3>(t) == 4 || std::get<3>(t) == 9);
+
+  int even = gen::AnyOf(gen::Just(0), gen::Filter(
+      gen::InRange(0, 8), [] (int x) { return x % 2 == 0; }))();
+  ASSERT_EQ(even % 2, 0);
+
+  ASSERT(!(std::get<0>(t) == 9 && std::get<1>(t) == 'c' &&
+           std::get<3>(t) == 9))
+      << "tuple: " << std::get<0>(t) << " " << std::get<1>(t) << " "
+      << std::get<3>(t) << " " << even;
+}
+
+struct Tree {
+  int value;
+  std::vector<std::shared_ptr<Tree>> children;
+};
+
+static unsigned Depth(const Tree &tree) {
+  unsigned depth = 0;
+  for (const auto &child : tree.children) {
+    unsigned d = Depth(*child);
+    if (d > depth) {
+      depth = d;
+    }
+  }
+  return depth + 1;
+}
+
+static std::string Show(const Tree &tree) {
+  std::stringstream ss;
+  ss << "(" << tree.value;
+  for (const auto &child : tree.children) {
+    ss << " " << Show(*child);
+  }
+  ss << ")";
+  return ss.str();
+}
+
+TEST(Generators, Tree) {
+  auto tree = gen::Recursive<Tree>(3, [] (gen::Recurse<Tree> recurse) {
+    Tree t;
+    t.value = gen::InRange(0, 3)();
+    unsigned num_children =
+        recurse.CanRecurse() ? gen::InRange(0u, 2u)() : 0u;
+    for (unsigned i = 0; i < num_children; i++) {
+      t.children.push_back(std::make_shared<Tree>(recurse()));
+    }
+    return t;
+  });
+  Tree t = tree();
+
+  ASSERT_LE(Depth(t), 4u);
+  ASSERT(!(Depth(t) == 4 && t.value == 3 && t.children.size() == 2))
+      << "tree: " << Show(t);
+}
+
+#if __cplusplus >= 201703L
+
+TEST(Generators, OptionalVariant) {
+  std::optional<int> maybe = gen::Optional(gen::InRange(1, 5))();
+  std::variant<int, char> either =
+      gen::Variant(gen::InRange(10, 20), gen::Element('x', 'y'))();
+
+  if (maybe) {
+    ASSERT(*maybe >= 1 && *maybe <= 5);
+  }
+  if (either.index() == 0) {
+    ASSERT(std::get<0>(either) >= 10 && std::get<0>(either) <= 20);
+  } else {
+    ASSERT(std::get<1>(either) == 'x' || std::get<1>(either) == 'y');
+  }
+  ASSERT(!(maybe && *maybe == 5 && either.index() == 1 &&
+           std::get<1>(either) == 'y'))
+      << "optional and variant: " << maybe.value_or(0) << " "
+      << (either.index() == 1 ? std::get<1>(either) : '-');
+}
+
+#endif  // __cplusplus >= 201703L
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2019 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <deepstate/DeepState.hpp>
+
+using namespace deepstate;
+
+// Reads more input than fits in the default input buffer, to show what
+// `--input_exhaustion` does once the input runs out.
+TEST(InputExhaustion, ReadPastTheEnd) {
+  unsigned first = DeepState_UInt();
+  unsigned num_nonzero = first != 0;
+  unsigned checksum = first;
+  for (int i = 1; i < 3 * 1024; i++) {
+    unsigned x = DeepState_UInt();
+    num_nonzero += x != 0;
+    checksum = checksum * 31 + x;
+  }
+  LOG(INFO) << "first " << first << ", " << num_nonzero
+            << " nonzero, checksum " << checksum;
+}
@@ -46,6 +46,29 @@
 # define DEEPSTATE_NOINLINE __attribute__((noinline))
 #endif
 
+/* Branch prediction hints. */
+#if defined(_MSC_VER)
+# define DEEPSTATE_LIKELY(x) (x)
+# define DEEPSTATE_UNLIKELY(x) (x)
+#else
+# define DEEPSTATE_LIKELY(x) __builtin_expect(!!(x), 1)
+# define DEEPSTATE_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#endif
+
+/* Reverse the bytes of an integer, and tell whether the target stores
+ * integers least significant byte first. */
+#if defined(_MSC_VER)
+# define DEEPSTATE_BSWAP16(x) _byteswap_ushort(x)
+# define DEEPSTATE_BSWAP32(x) _byteswap_ulong(x)
+# define DEEPSTATE_BSWAP64(x) _byteswap_uint64(x)
+# define DEEPSTATE_LITTLE_ENDIAN 1
+#else
+# define DEEPSTATE_BSWAP16(x) __builtin_bswap16(x)
+# define DEEPSTATE_BSWAP32(x) __builtin_bswap32(x)
+# define DEEPSTATE_BSWAP64(x) __builtin_bswap64(x)
+# define DEEPSTATE_LITTLE_ENDIAN (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#endif
+
 /* Introduce a trap instruction to halt execution. */
 #if defined(_MSC_VER)
 # include <intrin.h>
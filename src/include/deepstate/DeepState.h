@@ -19,6 +19,8 @@
 
 #include <assert.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <libgen.h>
 #include <setjmp.h>
 #include <signal.h>
@@ -36,6 +38,10 @@
 #include <unistd.h>
 #include <fnmatch.h>
 
+#ifdef __cplusplus
+#include <type_traits>
+#endif
+
 #include <deepstate/Log.h>
 #include <deepstate/Compiler.h>
 #include <deepstate/Option.h>
@@ -54,10 +60,16 @@
 #define srand DeepState_Warn_srand
 #endif
 
+/* Default size of the input buffer; `--max_input_size` overrides it. */
 #ifndef DEEPSTATE_SIZE
 #define DEEPSTATE_SIZE 8192
 #endif
 
+/* Number of entries kept by the `--trace_reads` ring buffer. */
+#ifndef DEEPSTATE_TRACE_SIZE
+#define DEEPSTATE_TRACE_SIZE 65536
+#endif
+
 #ifndef DEEPSTATE_MAX_SWARM_CONFIGS
 #define DEEPSTATE_MAX_SWARM_CONFIGS 1024
 #endif
@@ -66,6 +78,12 @@
 #define DEEPSTATE_SWARM_MAX_PROB_RATIO 16
 #endif
 
+/* Messages below this level are compiled out, whatever `--min_log_level`
+ * says. Errors and fatal errors, which fail tests, are always kept. */
+#ifndef DEEPSTATE_MIN_LOG_LEVEL
+#define DEEPSTATE_MIN_LOG_LEVEL DeepState_LogDebug
+#endif
+
 #define MAYBE(...) \
     if (DeepState_Bool()) { \
       __VA_ARGS__ ; \
@@ -79,14 +97,18 @@ DECLARE_string(input_test_files_dir);
 DECLARE_string(input_which_test);
 DECLARE_string(output_test_dir);
 DECLARE_string(test_filter);
+DECLARE_string(trace_reads);
+DECLARE_string(input_exhaustion);
 
 DECLARE_bool(take_over);
 DECLARE_bool(abort_on_fail);
 DECLARE_bool(exit_on_fail);
 DECLARE_bool(verbose_reads);
+DECLARE_bool(defer_log);
 DECLARE_bool(fuzz);
 DECLARE_bool(fuzz_save_passing);
 DECLARE_bool(fork);
+DECLARE_bool(fork_server);
 DECLARE_bool(list_tests);
 DECLARE_bool(boring_only);
 DECLARE_bool(run_disabled);
@@ -95,19 +117,121 @@ DECLARE_int(min_log_level);
 DECLARE_int(seed);
 DECLARE_int(timeout);
 
-enum {
-  DeepState_InputSize = DEEPSTATE_SIZE
-};
+DECLARE_uint(num_workers);
+DECLARE_uint(persistent_replay);
+DECLARE_uint(max_input_size);
+
+/* Set when libFuzzer's own output shouldn't quiet DeepState's. */
+extern int DeepState_LibFuzzerLoud;
+
+/* Would a message at `level` be logged? If not, there is no need to format
+ * it. Symbolic executors are shown every message. */
+DEEPSTATE_INLINE static int DeepState_LogLevelEnabled(
+    enum DeepState_LogLevel level) {
+  if ((int) level < DEEPSTATE_MIN_LOG_LEVEL && level < DeepState_LogError) {
+    return 0;
+  } else if (DEEPSTATE_UNLIKELY(DeepState_UsingSymExec)) {
+    return 1;
+  }
+  return (int) level >= FLAGS_min_log_level &&
+         (level >= DeepState_LogExternal || !DeepState_UsingLibFuzzer ||
+          DeepState_LibFuzzerLoud);
+}
 
+/* Size of the input buffer, in bytes. This is `DEEPSTATE_SIZE`, unless
+ * changed with `--max_input_size`. It isn't a constant expression; use
+ * `DEEPSTATE_SIZE` where one is needed. */
+extern uint32_t DeepState_InputSize;
 
 /* Byte buffer that will contain symbolic data that is used to supply requests
- * for symbolic values (e.g. `int`s). */
-extern volatile uint8_t DeepState_Input[DeepState_InputSize];
+ * for symbolic values (e.g. `int`s). It holds `DeepState_InputSize` bytes.
+ * The fuzzer builds of the library (`deepstate_LF`, `deepstate_AFL`,
+ * `deepstate_HFUZZ`) are compiled with `DEEPSTATE_NONVOLATILE_INPUT`, and
+ * don't treat the bytes as volatile. */
+extern volatile uint8_t *DeepState_Input;
+
+/* Resize the input buffer to `size` bytes, growing it if needed. The buffer
+ * can't grow when running symbolically. */
+extern void DeepState_SetInputSize(uint32_t size);
 
 /* Index into the `DeepState_Input` array that tracks how many input bytes have
  * been consumed. */
 extern uint32_t DeepState_InputIndex;
 
+/* Number of bytes at the start of `DeepState_Input` that hold input. This is
+ * the whole buffer, except when fuzzing, where input bytes are generated
+ * lazily as the test reads them. */
+extern uint32_t DeepState_InputGenerated;
+
+/* Generate fuzzing input up to (at least) byte `end` of `DeepState_Input`. */
+extern void DeepState_GenerateInput(uint32_t end);
+
+/* Zero `DeepState_Input` from byte `size` onwards. Only the part of the
+ * buffer that earlier inputs used is cleared. */
+extern void DeepState_ClearInputFrom(uint32_t size);
+
+/* Note that the input loaded into `DeepState_Input` ends after `size` bytes.
+ * With `--input_exhaustion extend`, the rest of it is then generated from
+ * those bytes, rather than being zeros. */
+extern void DeepState_SetInputEnd(uint32_t size);
+
+/* What an entry of the `--trace_reads` trace records. */
+enum DeepState_TraceEvent {
+  DeepState_TraceRead = 1,         /* `size` input bytes read at `offset`. */
+  DeepState_TraceOneOfBegin = 2,   /* A `OneOf` starting at `offset`. */
+  DeepState_TraceOneOfEnd = 3,     /* A `OneOf` ending at `offset`. */
+  DeepState_TraceRangeConversion = 4  /* The last read, mapped to `value`. */
+};
+
+/* How the bytes of a `DeepState_TraceRead` were read. */
+enum DeepState_TraceReadType {
+  DeepState_TraceBytes = 0,        /* Raw bytes, e.g. `DeepState_Malloc`. */
+  DeepState_TraceNoNullBytes = 1,  /* Raw bytes, with nulls made ones. */
+  DeepState_TraceBool = 2,         /* A `DeepState_Bool`. */
+  DeepState_TraceInt = 3           /* A big-endian integer. */
+};
+
+/* One entry of the trace. */
+struct DeepState_TraceEntry {
+  uint16_t event;
+  uint16_t type;
+  uint32_t offset;
+  uint32_t size;
+  uint32_t reserved;
+  int64_t value;
+};
+
+/* The trace file starts with this header, followed by a ring buffer of
+ * `capacity` entries, in which entry `i` is at index `i % capacity`. The
+ * file is mapped into memory, so it stays up to date even if the test
+ * crashes, or runs in a forked process. */
+struct DeepState_TraceHeader {
+  uint32_t magic;     /* `DEEPSTATE_TRACE_MAGIC`. */
+  uint32_t capacity;
+  uint64_t count;     /* Number of entries recorded by the current test. */
+};
+
+#define DEEPSTATE_TRACE_MAGIC 0x52545344u  /* "DSTR" */
+
+/* Header of the trace file, or `NULL` if reads aren't being traced. */
+extern struct DeepState_TraceHeader *DeepState_ReadTrace;
+
+/* Add an entry to the trace. */
+extern void DeepState_AddTraceEntry(enum DeepState_TraceEvent event,
+                                    enum DeepState_TraceReadType type,
+                                    uint32_t offset, uint32_t size,
+                                    int64_t value);
+
+/* Record an event at the current input offset, if tracing. */
+DEEPSTATE_INLINE static void DeepState_TraceInput(
+    enum DeepState_TraceEvent event, enum DeepState_TraceReadType type,
+    size_t size, int64_t value) {
+  if (DEEPSTATE_UNLIKELY(DeepState_ReadTrace != NULL)) {
+    DeepState_AddTraceEntry(event, type, DeepState_InputIndex,
+                            (uint32_t) size, value);
+  }
+}
+
 enum DeepState_SwarmType {
   DeepState_SwarmTypePure = 0,
   DeepState_SwarmTypeMixed = 1,
@@ -116,7 +240,7 @@ enum DeepState_SwarmType {
 
 /* Contains info about a swarm configuration */
 struct DeepState_SwarmConfig {
-  char* file;
+  const char* file;
   unsigned line;
   unsigned orig_fcount;
   /* We identify a configuration by these first three elements of the struct */
@@ -246,7 +370,8 @@ extern const char *DeepState_ConcretizeCStr(const char *begin);
 extern void *DeepState_Malloc(size_t num_bytes);
 
 /* Allocate and return a pointer to `num_bytes` symbolic bytes.
-   Ptr will be freed by DeepState at end of test. */
+   Ptr will be freed by DeepState at end of test, and must not be
+   passed to `free`. */
 extern void *DeepState_GCMalloc(size_t num_bytes);
 
 /* Returns the path to a testcase without parsing to any aforementioned types */
@@ -328,6 +453,24 @@ DEEPSTATE_INLINE static void DeepState_Check(int expr) {
   }
 }
 
+/* Returns a value in `[0, span]`, read from the fewest whole bytes of input
+ * that can hold `span`. */
+extern uint64_t DeepState_CompactRange(uint64_t span);
+
+/* A harness and the library it links against must agree on
+ * `DEEPSTATE_COMPACT_RANGES`, or they read ranges differently. The library
+ * only defines the symbol for its own setting, and every harness refers to
+ * the one for its setting, so a mismatch fails to link. */
+#ifdef DEEPSTATE_COMPACT_RANGES
+#define DeepState_CompactRangesSetting DeepState_CompactRangesOn
+#else
+#define DeepState_CompactRangesSetting DeepState_CompactRangesOff
+#endif
+extern const int DeepState_CompactRangesSetting;
+__attribute__((used))
+static const int *const DeepState_CompactRangesCheck =
+    &DeepState_CompactRangesSetting;
+
 /* Return a symbolic value in a the range `[low_inc, high_inc]`. */
 /* Saturating version here is an alternative, but worse for fuzzing:
 #define DEEPSTATE_MAKE_SYMBOLIC_RANGE(Tname, tname) \
@@ -350,6 +493,22 @@ DEEPSTATE_INLINE static void DeepState_Check(int expr) {
       } \
     }
 */
+#ifdef DEEPSTATE_COMPACT_RANGES
+/* Draw only as many bytes as the range needs. Inputs saved this way are
+ * read differently from those saved without `DEEPSTATE_COMPACT_RANGES`. */
+#define DEEPSTATE_MAKE_SYMBOLIC_RANGE(Tname, tname) \
+    DEEPSTATE_INLINE static tname DeepState_ ## Tname ## InRange( \
+        tname low, tname high) { \
+      if (low > high) { \
+        return DeepState_ ## Tname ## InRange(high, low); \
+      } \
+      if (low == high) { \
+        return low;	 \
+      } \
+      return (tname) ((uint64_t) low + DeepState_CompactRange( \
+          (uint64_t) high - (uint64_t) low)); \
+    }
+#else
 #define DEEPSTATE_MAKE_SYMBOLIC_RANGE(Tname, tname) \
     DEEPSTATE_INLINE static tname DeepState_ ## Tname ## InRange( \
         tname low, tname high) { \
@@ -374,10 +533,14 @@ DEEPSTATE_INLINE static void DeepState_Check(int expr) {
         if (FLAGS_verbose_reads) { \
           printf("Converting out-of-range value to %lld\n", (long long)(low + (x % size))); \
         } \
+        DeepState_TraceInput(DeepState_TraceRangeConversion, \
+                             DeepState_TraceInt, 0, \
+                             (int64_t) (low + (x % size))); \
         return low + (x % size); \
       } \
       return x; \
     }
+#endif  /* DEEPSTATE_COMPACT_RANGES */
 
 DEEPSTATE_MAKE_SYMBOLIC_RANGE(Size, size_t)
 DEEPSTATE_MAKE_SYMBOLIC_RANGE(Long, long)
@@ -392,6 +555,32 @@ DEEPSTATE_MAKE_SYMBOLIC_RANGE(UChar, unsigned char)
 
 #undef DEEPSTATE_MAKE_SYMBOLIC_RANGE
 
+/* Ways to spread the values of `DeepState_FloatInRangeUsing` and
+ * `DeepState_DoubleInRangeUsing` over their range. */
+enum DeepState_FloatDistribution {
+  /* Uniform in value. Falls back to `DeepState_FloatBits` if a bound is
+   * infinite. */
+  DeepState_FloatUniform = 0,
+
+  /* Uniform over the representable values, i.e. their bit patterns, so
+   * that values near zero are as likely as big ones. */
+  DeepState_FloatBits = 1,
+
+  /* Like `DeepState_FloatBits` half of the time, and otherwise one of the
+   * bounds, their neighbours, zeros, +-1, the smallest and biggest values,
+   * or infinities, clamped to the range. */
+  DeepState_FloatEdges = 2
+};
+
+/* Return a value in `[low, high]`, spread according to `distribution`.
+ * These never abandon the test for a value out of range: every input maps
+ * to one in range, and each call reads a fixed number of bytes. */
+extern float DeepState_FloatInRangeUsing(
+    float low, float high, enum DeepState_FloatDistribution distribution);
+extern double DeepState_DoubleInRangeUsing(
+    double low, double high, enum DeepState_FloatDistribution distribution);
+
+/* Like the above, using `DeepState_FloatBits`. */
 extern float DeepState_FloatInRange(float low, float high);
 extern double DeepState_DoubleInRange(double low, double high);
 
@@ -445,46 +634,174 @@ DEEPSTATE_INLINE static int DeepState_IsSymbolicDouble(double x) {
   return DeepState_IsSymbolicUInt64(*((uint64_t *) &x));
 }
 
-/* Basically an ASSUME that also assigns to v; P should be side-effect
-   free, and type of v should be integral. */
+/* Ways for `ASSIGN_SATISFYING` to search for a value satisfying its
+ * predicate, when the drawn value doesn't. */
+enum DeepState_SearchStrategy {
+  /* Try values ever further above and below the drawn value. */
+  DeepState_SearchScan = 0,
+
+  /* Find the satisfying value nearest the drawn value by bisection. Only
+   * correct for predicates that are monotone in `v`. */
+  DeepState_SearchBisect = 1,
+
+  /* Try pseudo-random values, derived from the drawn value. */
+  DeepState_SearchRandom = 2,
+
+  /* Try values that satisfied the predicate at the same call site earlier
+   * in the same test, then scan. */
+  DeepState_SearchCached = 3
+};
+
+/* Strategy of `ASSIGN_SATISFYING` and `ASSIGN_SATISFYING_IN_RANGE`. */
+#ifndef DEEPSTATE_SEARCH_STRATEGY
+#define DEEPSTATE_SEARCH_STRATEGY DeepState_SearchScan
+#endif
+
+/* Number of values each search may try before abandoning the test. */
 #ifndef DEEPSTATE_MAX_SEARCH_ITERS
-#define DEEPSTATE_MAX_SEARCH_ITERS UINT_MAX
+#define DEEPSTATE_MAX_SEARCH_ITERS 65536
 #endif
 
-#define ASSIGN_SATISFYING(v, expr, P) \
+#ifndef DEEPSTATE_SEARCH_CACHE_SIZE
+#define DEEPSTATE_SEARCH_CACHE_SIZE 8
+#endif
+
+/* Number of `ASSIGN_SATISFYING` call sites whose searches are counted. */
+#ifndef DEEPSTATE_MAX_SEARCH_SITES
+#define DEEPSTATE_MAX_SEARCH_SITES 256
+#endif
+
+/* How often an `ASSIGN_SATISFYING` call site has searched, and run out of
+ * tries. These are kept in memory shared with forked tests. */
+struct DeepState_SearchStats {
+  const void *site;
+  const char *file;
+  unsigned line;
+  unsigned long long num_searches;
+  unsigned long long num_budget_hits;  /* Searches that ran out of tries. */
+};
+
+/* An `ASSIGN_SATISFYING` call site, and what it has done so far. It starts
+ * out zeroed. */
+struct DeepState_SearchSite {
+  struct DeepState_SearchStats *stats;
+  unsigned long long cache_epoch;      /* Test that filled `cache`. */
+  unsigned cache_count;
+  unsigned long long cache[DEEPSTATE_SEARCH_CACHE_SIZE];
+};
+
+/* One search. Values are kept in an encoding of the type of `v` as unsigned
+ * numbers in the same order, so that all types search alike. `value` is the
+ * value to try next, or that was found, as a `v` would convert it. */
+struct DeepState_Search {
+  struct DeepState_SearchSite *site;
+  enum DeepState_SearchStrategy strategy;
+  unsigned long long budget;
+  unsigned long long iters;
+  unsigned long long mask;   /* Bits of the type. */
+  unsigned long long bias;   /* Added to signed values. */
+  int is_signed;
+  int found;
+  int done;
+  unsigned long long start;
+  unsigned long long low;
+  unsigned long long high;
+  unsigned long long current;
+  unsigned long long up;
+  unsigned long long down;
+  unsigned long long bisect_false;
+  unsigned long long bisect_true;
+  int phase;
+  unsigned cache_index;
+  unsigned long long value;
+};
+
+/* Start a search at `start`, within `[low, high]` if `has_range`, for the
+ * call site `site` at `file(line)`. */
+extern void DeepState_BeginSearch(struct DeepState_Search *search,
+                                  struct DeepState_SearchSite *site,
+                                  const char *file, unsigned line,
+                                  enum DeepState_SearchStrategy strategy,
+                                  unsigned long long budget, int is_signed,
+                                  size_t size, unsigned long long start,
+                                  int has_range, unsigned long long low,
+                                  unsigned long long high);
+
+/* Given whether `search->value` satisfied the predicate, pick the next value
+ * to try. Returns 0 when the search is over. */
+extern int DeepState_NextCandidate(struct DeepState_Search *search, int ok);
+
+/* Finish a search. Returns 0 if no satisfying value was found. */
+extern int DeepState_EndSearch(struct DeepState_Search *search);
+
+/* The value of integral `x` as an `unsigned long long`, sign-extended if
+ * `x` has a signed type. */
+#define DEEPSTATE_SEARCH_RAW(is_signed, x) \
+  ((is_signed) ? (unsigned long long) (long long) (x) : \
+                 (unsigned long long) (x))
+
+/* Whether integral `v` has a signed type, without comparing anything to
+ * zero, which would warn for unsigned types. */
+#ifdef __cplusplus
+#define DEEPSTATE_SEARCH_SIGNED(v) \
+  (std::is_signed<typename std::decay<decltype(v)>::type>::value)
+#else
+#define DEEPSTATE_SEARCH_SIGNED(v) \
+  ((__typeof__(v)) -1 < (__typeof__(v)) 1)
+#endif
+
+/* Search for a value of `v` that satisfies `P`, starting from the current
+ * value of `v`, and abandon the test if there is none. */
+#define _DEEPSTATE_SEARCH(strategy, budget, v, is_signed, has_range, low, \
+                          high, P) \
+  do { \
+    static struct DeepState_SearchSite DeepState_search_site; \
+    struct DeepState_Search DeepState_search; \
+    DeepState_BeginSearch(&DeepState_search, &DeepState_search_site, \
+                          __FILE__, __LINE__, (strategy), (budget), (is_signed), sizeof(v), \
+                          DEEPSTATE_SEARCH_RAW(is_signed, v), (has_range), \
+                          DEEPSTATE_SEARCH_RAW(is_signed, low), \
+                          DEEPSTATE_SEARCH_RAW(is_signed, high)); \
+    int DeepState_search_ok = (P); \
+    while (DeepState_NextCandidate(&DeepState_search, DeepState_search_ok)) { \
+      v = DeepState_search.value; \
+      DeepState_search_ok = (P); \
+    } \
+    if (!DeepState_EndSearch(&DeepState_search)) { \
+      (void) DeepState_Assume(0); \
+    } \
+    v = DeepState_search.value; \
+  } while (0)
+
+/* Basically an ASSUME that also assigns to v; P should be side-effect
+   free, and type of v should be integral. The search for a satisfying value
+   uses `strategy`, and tries at most `budget` values. */
+#define ASSIGN_SATISFYING_USING(strategy, budget, v, expr, P) \
   do { \
+    int DeepState_v_signed = DEEPSTATE_SEARCH_SIGNED(v); \
     v = (expr); \
     if (DeepState_UsingSymExec) { \
       (void) DeepState_Assume(P); \
     } else { \
-      unsigned long long DeepState_assume_iters = 0; \
-      unsigned long long DeepState_safe_incr_v = (unsigned long long) v; \
-      unsigned long long DeepState_safe_decr_v = (unsigned long long) v; \
-      while(!(P)) { \
-	if (DeepState_assume_iters > DEEPSTATE_MAX_SEARCH_ITERS) { \
-	  (void) DeepState_Assume(0); \
-	} \
-	DeepState_assume_iters++; \
-	DeepState_safe_incr_v++; \
-        v = DeepState_safe_incr_v; \
-	if (!(P)) { \
-	  DeepState_safe_decr_v--;   \
-          v = DeepState_safe_decr_v; \
-	} \
-      } \
+      _DEEPSTATE_SEARCH(strategy, budget, v, DeepState_v_signed, 0, 0, 0, P); \
     } \
   } while (0);
 
+#define ASSIGN_SATISFYING(v, expr, P) \
+  ASSIGN_SATISFYING_USING(DEEPSTATE_SEARCH_STRATEGY, \
+                          DEEPSTATE_MAX_SEARCH_ITERS, v, expr, P)
+
 /* Basically an ASSUME that also assigns to v in range low to high;
    P should be side-effect free, and type of v should be integral. */
-
-#define ASSIGN_SATISFYING_IN_RANGE(v, expr, low, high, P) \
+#define ASSIGN_SATISFYING_IN_RANGE_USING(strategy, budget, v, expr, low, \
+                                         high, P) \
   do { \
     ASSERT (low <= high) << "low (" << low << ") > high (" << high << ")"; \
     if (low == high) { \
       v = low; \
       break; \
     } \
+    int DeepState_v_signed = DEEPSTATE_SEARCH_SIGNED(v); \
     v = (expr); \
     if (DeepState_UsingSymExec) { \
       (void) DeepState_Assume(low <= v && v <= high); \
@@ -495,28 +812,16 @@ DEEPSTATE_INLINE static int DeepState_IsSymbolicDouble(double x) {
         if (v < 0) v = 0; \
 	v = low + (v % ((high - low) + 1)); \
       } \
-      unsigned long long DeepState_assume_iters = 0; \
-      unsigned long long DeepState_safe_incr_v = (unsigned long long) v; \
-      unsigned long long DeepState_safe_decr_v = (unsigned long long) v; \
-      while(!(P)) { \
-	if (DeepState_assume_iters > DEEPSTATE_MAX_SEARCH_ITERS) { \
-	  (void) DeepState_Assume(0); \
-	} \
-	DeepState_assume_iters++; \
-	if (DeepState_safe_incr_v < high) { \
-	  DeepState_safe_incr_v++; \
-          v = DeepState_safe_incr_v; \
-	} else if (DeepState_safe_decr_v == low) { \
-	  (void) DeepState_Assume(0); \
-	} \
-	if (!(P) && (DeepState_safe_decr_v > low)) {	\
-	  DeepState_safe_decr_v--; \
-          v = DeepState_safe_decr_v; \
-	} \
-      } \
+      _DEEPSTATE_SEARCH(strategy, budget, v, DeepState_v_signed, 1, low, \
+                        high, P); \
     } \
   } while (0);
 
+#define ASSIGN_SATISFYING_IN_RANGE(v, expr, low, high, P) \
+  ASSIGN_SATISFYING_IN_RANGE_USING(DEEPSTATE_SEARCH_STRATEGY, \
+                                   DEEPSTATE_MAX_SEARCH_ITERS, v, expr, \
+                                   low, high, P)
+
 /* Used to define the entrypoint of a test case. */
 #define DeepState_EntryPoint(test_name) \
     _DeepState_EntryPoint(test_name, __FILE__, __LINE__)
@@ -573,6 +878,12 @@ extern void DeepState_Setup(void);
 /* Tear down DeepState. */
 extern void DeepState_Teardown(void);
 
+/* Map the shared memory that a forked test uses to report its result. */
+extern void DeepState_AllocCurrentTestRun(void);
+
+/* Stop this process's fork server, if it has one. */
+extern void DeepState_StopForkServer(void);
+
 /* Notify that we're about to begin a test while running under Dr. Fuzz. */
 extern void DeepState_BeginDrFuzz(struct DeepState_TestInfo *info);
 
@@ -632,36 +943,37 @@ extern void DeepState_Warn_srand(unsigned int seed);
 static void DeepState_InitInputFromFile(const char *path) {
   struct stat stat_buf;
 
-  FILE *fp = fopen(path, "r");
-  if (fp == NULL) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
     /* TODO(joe): Add error log with more info. */
     DeepState_Abandon("Unable to open file");
   }
 
-  int fd = fileno(fp);
-  if (fd < 0) {
-    DeepState_Abandon("Tried to get file descriptor for invalid stream");
-  }
   if (fstat(fd, &stat_buf) < 0) {
+    close(fd);
     DeepState_Abandon("Unable to access input file");
   };
 
   size_t to_read = stat_buf.st_size;
 
-  if (stat_buf.st_size > sizeof(DeepState_Input)) {
+  if (stat_buf.st_size > DeepState_InputSize) {
     DeepState_LogFormat(DeepState_LogWarning, "File too large, truncating to max input size");
     to_read = DeepState_InputSize;
   }
 
-  /* Reset the input buffer and reset the index. */
-  DeepState_MemScrub((void *) DeepState_Input, sizeof(DeepState_Input));
+  /* Reset the index. */
   DeepState_InputIndex = 0;
+  DeepState_InputGenerated = DeepState_InputSize;
   DeepState_SwarmConfigsIndex = 0;
 
-  size_t count = fread((void *) DeepState_Input, 1, to_read, fp);
-  fclose(fp);
+  /* Read the file straight into the input buffer, then clear only what the
+   * previous input left after it. */
+  ssize_t count = pread(fd, (void *) DeepState_Input, to_read, 0);
+  close(fd);
+  DeepState_ClearInputFrom(count > 0 ? (uint32_t) count : 0);
+  DeepState_SetInputEnd(count > 0 ? (uint32_t) count : 0);
 
-  if (count != to_read) {
+  if (count != (ssize_t) to_read) {
     /* TODO(joe): Add error log with more info. */
     DeepState_Abandon("Error reading file");
   }
@@ -683,6 +995,7 @@ static void DeepState_RunTest(struct DeepState_TestInfo *test) {
     try {
 #endif  /* __cplusplus */
 
+      DeepState_HoldLog();
       test->test_func();  /* Run the test function. */
       exit(DeepState_TestRunPass);
 
@@ -727,6 +1040,7 @@ static int DeepState_RunTestNoFork(struct DeepState_TestInfo *test) {
     try {
 #endif  /* __cplusplus */
 
+      DeepState_HoldLog();
       test->test_func();  /* Run the test function. */
       return(DeepState_TestRunPass);
 
@@ -765,19 +1079,26 @@ static int DeepState_RunTestNoFork(struct DeepState_TestInfo *test) {
   }
 }
 
+extern bool DeepState_ForkServerRunTest(struct DeepState_TestInfo *test,
+                                        int *wstatus);
+
 /* Fork and run `test`. */
 static enum DeepState_TestRunResult
 DeepState_ForkAndRunTest(struct DeepState_TestInfo *test) {
   pid_t test_pid;
+  int wstatus = 0;
   if (FLAGS_fork) {
+    DeepState_ShareLog();
+  }
+  if (FLAGS_fork && FLAGS_fork_server &&
+      DeepState_ForkServerRunTest(test, &wstatus)) {
+    /* The fork server ran the test for us. */
+  } else if (FLAGS_fork) {
     test_pid = fork();
     if (!test_pid) {
       DeepState_RunTest(test);
       /* No need to clean up in a fork; exit() is the ultimate garbage collector */
     }
-  }
-  int wstatus = 0;
-  if (FLAGS_fork) {
     waitpid(test_pid, &wstatus, 0);
   } else {
     wstatus = DeepState_RunTestNoFork(test);
@@ -793,28 +1114,37 @@ DeepState_ForkAndRunTest(struct DeepState_TestInfo *test) {
   }
 
   /* If here, we exited abnormally but didn't catch it in the signal
-   * handler, and thus the test failed due to a crash. */
+   * handler, and thus the test failed due to a crash. It never got to write
+   * out any log it held back, so we do. */
+  DeepState_FlushDeadLog(NULL);
   return DeepState_TestRunCrash;
 }
 
 extern enum DeepState_TestRunResult DeepState_FuzzOneTestCase(struct DeepState_TestInfo *test);
 
+/* Returns the path of the saved test case file `name` in directory `dir`,
+ * or just `name` if `dir` is empty. The caller must free the path. */
+static char *DeepState_SavedTestCasePath(const char *dir, const char *name) {
+  size_t path_len = 2 + sizeof(char) * (strlen(dir) + strlen(name));
+  char *path = (char *) malloc(path_len);
+  if (path == NULL) {
+    DeepState_Abandon("Error allocating memory");
+  }
+  if (strncmp(dir, "", strlen(dir)) != 0) {
+    snprintf(path, path_len, "%s/%s", dir, name);
+  } else {
+    snprintf(path, path_len, "%s", name);
+  }
+  return path;
+}
+
 /* Run a single saved test case with input initialized from the file
  * `name` in directory `dir`. */
 static enum DeepState_TestRunResult
 DeepState_RunSavedTestCase(struct DeepState_TestInfo *test, const char *dir,
                            const char *name) {
   if (!setjmp(DeepState_ReturnToRun)) {
-    size_t path_len = 2 + sizeof(char) * (strlen(dir) + strlen(name));
-    char *path = (char *) malloc(path_len);
-    if (path == NULL) {
-      DeepState_Abandon("Error allocating memory");
-    }
-    if (strncmp(dir, "", strlen(dir)) != 0) {
-      snprintf(path, path_len, "%s/%s", dir, name);
-    } else {
-      snprintf(path, path_len, "%s", name);
-    }
+    char *path = DeepState_SavedTestCasePath(dir, name);
 
     DeepState_InitInputFromFile(path);
 
@@ -846,10 +1176,360 @@ DeepState_RunSavedTestCase(struct DeepState_TestInfo *test, const char *dir,
   }
 }
 
-/* Run a single test many times, initialized against each saved test case in
- * `FLAGS_input_test_dir`. */
-static int DeepState_RunSavedCasesForTest(struct DeepState_TestInfo *test) {
-  int num_failed_tests = 0;
+/* A test to run: the test, and the saved test case file holding its input,
+ * or a `NULL` name to run the test on fresh input. */
+struct DeepState_SavedTestCase {
+  struct DeepState_TestInfo *test;
+  const char *dir;
+  char *name;
+};
+
+/* Append a test to run to the array `*cases`, which holds `*count` tests and
+ * has room for `*capacity`. */
+static void DeepState_AddQueuedTest(struct DeepState_SavedTestCase **cases,
+                                    uint32_t *count, uint32_t *capacity,
+                                    struct DeepState_TestInfo *test,
+                                    const char *dir, const char *name) {
+  if (*count == *capacity) {
+    *capacity = *capacity ? (2 * *capacity) : 64;
+    *cases = (struct DeepState_SavedTestCase *) realloc(
+        *cases, *capacity * sizeof(struct DeepState_SavedTestCase));
+    if (*cases == NULL) {
+      DeepState_Abandon("Error allocating memory");
+    }
+  }
+
+  struct DeepState_SavedTestCase *queued = &((*cases)[*count]);
+  queued->test = test;
+  queued->dir = dir;
+  queued->name = NULL;
+  if (name != NULL) {
+    size_t name_len = strlen(name) + 1;
+    queued->name = (char *) malloc(name_len);
+    if (queued->name == NULL) {
+      DeepState_Abandon("Error allocating memory");
+    }
+    memcpy(queued->name, name, name_len);
+  }
+  (*count)++;
+}
+
+/* Collect the saved test cases in the open directory `dir_fd` (named `dir`)
+ * to run against `test`, appending them to `*cases` as with
+ * `DeepState_AddQueuedTest`. If `any_file` is set, then every regular file
+ * is used, otherwise only files named like saved test cases are. Returns the
+ * number of test cases found. */
+static uint32_t DeepState_ListSavedTestCases(
+    struct DeepState_TestInfo *test, const char *dir, DIR *dir_fd,
+    bool any_file, struct DeepState_SavedTestCase **cases, uint32_t *count,
+    uint32_t *capacity) {
+  uint32_t old_count = *count;
+  struct dirent *dp;
+  struct stat path_stat;
+
+  while ((dp = readdir(dir_fd)) != NULL) {
+    if (any_file) {
+      char *path = DeepState_SavedTestCasePath(dir, dp->d_name);
+      int is_file = !stat(path, &path_stat) && S_ISREG(path_stat.st_mode);
+      free(path);
+      if (!is_file) {
+        continue;
+      }
+    } else if (!DeepState_IsTestCaseFile(dp->d_name)) {
+      continue;
+    }
+    DeepState_AddQueuedTest(cases, count, capacity, test, dir, dp->d_name);
+  }
+
+  return *count - old_count;
+}
+
+/* Free an array of tests made by `DeepState_AddQueuedTest`. */
+static void DeepState_FreeSavedTestCases(struct DeepState_SavedTestCase *cases,
+                                         uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    free(cases[i].name);
+  }
+  free(cases);
+}
+
+/* Returns `true` if `result` should end a replay early, because it is a
+ * failure and we've been asked to abort or exit on failures. */
+static bool DeepState_StopsReplay(enum DeepState_TestRunResult result) {
+  return (FLAGS_abort_on_fail || FLAGS_exit_on_fail) &&
+         ((result == DeepState_TestRunFail) ||
+          (result == DeepState_TestRunCrash));
+}
+
+/* Run one queued test: either a saved test case, or, if there is no input
+ * file, the test on fresh input. */
+static enum DeepState_TestRunResult
+DeepState_RunQueuedTest(struct DeepState_SavedTestCase *queued) {
+  if (queued->name != NULL) {
+    return DeepState_RunSavedTestCase(queued->test, queued->dir, queued->name);
+  }
+  DeepState_Begin(queued->test);
+  return DeepState_ForkAndRunTest(queued->test);
+}
+
+/* Queue of tests shared between the parent and its worker processes. It is
+ * followed by one `DeepState_TestWorker` per worker, then by the result of
+ * every queued test. */
+struct DeepState_TestQueue {
+  uint32_t next;      /* Index of the next test to claim. */
+  uint32_t num_run;   /* Number of tests run so far. */
+  int stop_on_fail;   /* Should a failure end the run early? */
+  int stop;           /* Set if a failure ends the run early. */
+};
+
+/* What one worker process is doing, so that the parent knows which test was
+ * running if the worker dies. */
+struct DeepState_TestWorker {
+  int32_t in_flight;  /* Index of the test being run, or `-1`. */
+  uint32_t num_run;   /* Number of tests run by this worker process. */
+};
+
+/* Record the result of the queued test at `index`. */
+static void DeepState_RecordQueuedResult(struct DeepState_TestQueue *queue,
+                                         enum DeepState_TestRunResult *results,
+                                         uint32_t index,
+                                         enum DeepState_TestRunResult result) {
+  results[index] = result;
+  __sync_fetch_and_add(&(queue->num_run), 1);
+  if (queue->stop_on_fail && DeepState_StopsReplay(result)) {
+    queue->stop = 1;
+  }
+}
+
+/* Report a queued test that crashed the worker process running it. This
+ * mirrors what `DeepState_RunSavedTestCase` reports for a crashed fork. */
+static void DeepState_ReportWorkerCrash(struct DeepState_SavedTestCase *queued) {
+  if (!setjmp(DeepState_ReturnToRun)) {
+    DeepState_LogFormat(DeepState_LogError, "Crashed: %s",
+                        queued->test->test_name);
+    if (queued->name != NULL) {
+      char *path = DeepState_SavedTestCasePath(queued->dir, queued->name);
+      DeepState_LogFormat(DeepState_LogError, "Test case %s crashed", path);
+      if (HAS_FLAG_output_test_dir) {
+        DeepState_InitInputFromFile(path);
+        DeepState_SaveCrashingTest();
+      }
+      free(path);
+    }
+    DeepState_Crash();
+  }
+}
+
+/* Runs in a worker process: claim tests from the shared queue and run them
+ * until the queue is empty. If `FLAGS_persistent_replay` is set, or if we
+ * aren't forking, then the tests run inside the worker, and it exits after
+ * `FLAGS_persistent_replay` of them so that the parent can start a fresh
+ * one. Otherwise, the worker forks for each test as usual. */
+DEEPSTATE_NORETURN
+static void DeepState_RunTestWorker(struct DeepState_SavedTestCase *queued,
+                                    uint32_t count,
+                                    struct DeepState_TestQueue *queue,
+                                    struct DeepState_TestWorker *worker,
+                                    enum DeepState_TestRunResult *results) {
+  uint32_t max_tests = UINT32_MAX;
+
+  /* The inherited test run info is shared with every other worker. */
+  DeepState_AllocCurrentTestRun();
+
+  /* Behave like a forked test process, which reports failures back to its
+   * parent rather than aborting on them. */
+  if (!FLAGS_fork || FLAGS_persistent_replay) {
+    FLAGS_fork = 0;
+    HAS_FLAG_abort_on_fail = 0;
+    if (FLAGS_persistent_replay) {
+      max_tests = FLAGS_persistent_replay;
+    }
+  }
+
+  for (uint32_t i = 0; i < max_tests && !queue->stop; i++) {
+    uint32_t index = __sync_fetch_and_add(&(queue->next), 1);
+    if (index >= count) {
+      break;
+    }
+    worker->in_flight = (int32_t) index;
+    DeepState_RecordQueuedResult(queue, results, index,
+                                 DeepState_RunQueuedTest(&(queued[index])));
+    worker->num_run++;
+    worker->in_flight = -1;
+  }
+  exit(0);
+}
+
+/* Fork a worker process for slot `slot`, which holds back its log in
+ * `log_rings[slot]`. Returns the worker's pid. */
+static pid_t DeepState_ForkTestWorker(struct DeepState_SavedTestCase *queued,
+                                      uint32_t count,
+                                      struct DeepState_TestQueue *queue,
+                                      struct DeepState_TestWorker *workers,
+                                      enum DeepState_TestRunResult *results,
+                                      struct DeepState_LogRing **log_rings,
+                                      unsigned slot) {
+  workers[slot].in_flight = -1;
+  workers[slot].num_run = 0;
+  pid_t worker_pid = fork();
+  if (!worker_pid) {
+    DeepState_UseLog(log_rings[slot]);
+    DeepState_RunTestWorker(queued, count, queue, &(workers[slot]), results);
+  } else if (worker_pid < 0) {
+    DeepState_Log(DeepState_LogError, "Unable to fork worker process");
+  }
+  return worker_pid;
+}
+
+/* Run the queued tests in a pool of `num_workers` worker processes. A worker
+ * that dies, or that exits once it has run its share of tests, is replaced
+ * for as long as there are tests left in the queue. */
+static uint32_t DeepState_RunTestWorkers(
+    struct DeepState_SavedTestCase *queued, uint32_t count,
+    enum DeepState_TestRunResult *results, bool stop_on_fail,
+    unsigned num_workers) {
+  if (num_workers > count) {
+    num_workers = count;
+  }
+
+  size_t shared_size = sizeof(struct DeepState_TestQueue) +
+                       num_workers * sizeof(struct DeepState_TestWorker) +
+                       count * sizeof(enum DeepState_TestRunResult);
+  void *shared_mem = mmap(NULL, shared_size, PROT_READ | PROT_WRITE,
+                          MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+  if (shared_mem == MAP_FAILED) {
+    DeepState_Log(DeepState_LogError, "Unable to map shared memory");
+    exit(1);
+  }
+
+  struct DeepState_TestQueue *queue = (struct DeepState_TestQueue *) shared_mem;
+  struct DeepState_TestWorker *workers =
+      (struct DeepState_TestWorker *) &(queue[1]);
+  enum DeepState_TestRunResult *shared_results =
+      (enum DeepState_TestRunResult *) &(workers[num_workers]);
+  queue->stop_on_fail = stop_on_fail;
+
+  pid_t *worker_pids = (pid_t *) malloc(num_workers * sizeof(pid_t));
+  struct DeepState_LogRing **log_rings = (struct DeepState_LogRing **)
+      malloc(num_workers * sizeof(struct DeepState_LogRing *));
+  if (worker_pids == NULL || log_rings == NULL) {
+    DeepState_Abandon("Error allocating memory");
+  }
+
+  /* Each worker holds back its log where we can write it out if the worker
+   * dies while running a test. */
+  for (unsigned slot = 0; slot < num_workers; slot++) {
+    log_rings[slot] = DeepState_NewSharedLog();
+  }
+
+  unsigned num_live = 0;
+  for (unsigned slot = 0; slot < num_workers; slot++) {
+    worker_pids[slot] = DeepState_ForkTestWorker(queued, count, queue, workers,
+                                                 shared_results, log_rings,
+                                                 slot);
+    if (worker_pids[slot] > 0) {
+      num_live++;
+    }
+  }
+
+  while (num_live > 0) {
+
+    /* Only wait for our workers, so that we don't reap (and lose the status
+     * of) other children of the test harness. */
+    int wstatus = 0;
+    unsigned slot = 0;
+    pid_t pid = 0;
+    for (; slot < num_workers; slot++) {
+      if (worker_pids[slot] > 0) {
+        pid = waitpid(worker_pids[slot], &wstatus, WNOHANG);
+        if (pid == worker_pids[slot] || (pid < 0 && errno == ECHILD)) {
+          break;
+        }
+      }
+    }
+    if (slot == num_workers) {
+      usleep(1000);
+      continue;
+    }
+    num_live--;
+    if (pid < 0) {
+      worker_pids[slot] = -1;
+      continue;
+    }
+    worker_pids[slot] = -1;
+
+    /* The worker died while running a test; the exit status or signal tells
+     * us the result, just like for a forked test. */
+    struct DeepState_TestWorker *worker = &(workers[slot]);
+    if (worker->in_flight >= 0) {
+      uint32_t index = (uint32_t) worker->in_flight;
+      enum DeepState_TestRunResult result = DeepState_TestRunCrash;
+      if (WIFEXITED(wstatus)) {
+        result = (enum DeepState_TestRunResult) WEXITSTATUS(wstatus);
+      } else {
+        if (log_rings[slot] != NULL) {
+          DeepState_FlushDeadLog(log_rings[slot]);
+        }
+        DeepState_ReportWorkerCrash(&(queued[index]));
+      }
+      DeepState_RecordQueuedResult(queue, shared_results, index, result);
+
+    } else if (!worker->num_run && queue->next < count) {
+      DeepState_Log(DeepState_LogError,
+                    "Worker process exited without running any tests");
+      continue;
+    }
+
+    if (queue->next < count && !queue->stop) {
+      worker_pids[slot] = DeepState_ForkTestWorker(
+          queued, count, queue, workers, shared_results, log_rings, slot);
+      if (worker_pids[slot] > 0) {
+        num_live++;
+      }
+    }
+  }
+
+  uint32_t num_run = queue->num_run;
+  memcpy(results, shared_results, count * sizeof(enum DeepState_TestRunResult));
+  for (unsigned slot = 0; slot < num_workers; slot++) {
+    DeepState_FreeSharedLog(log_rings[slot]);
+  }
+  free(log_rings);
+  free(worker_pids);
+  munmap(shared_mem, shared_size);
+  return num_run;
+}
+
+/* Run each of the `count` tests in `queued`, storing their results in
+ * `results`. Returns the number of tests run, which is less than `count` if
+ * `stop_on_fail` is set and a failure ended the run early; tests that were
+ * not run are left marked as passing. */
+static uint32_t DeepState_RunSavedTestCaseList(
+    struct DeepState_SavedTestCase *queued, uint32_t count,
+    enum DeepState_TestRunResult *results, bool stop_on_fail) {
+  memset(results, 0, count * sizeof(enum DeepState_TestRunResult));
+  if (!count) {
+    return 0;
+  }
+
+  if (FLAGS_num_workers > 1 || (FLAGS_fork && FLAGS_persistent_replay)) {
+    unsigned num_workers = FLAGS_num_workers > 1 ? FLAGS_num_workers : 1;
+    return DeepState_RunTestWorkers(queued, count, results, stop_on_fail,
+                                    num_workers);
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    results[i] = DeepState_RunQueuedTest(&(queued[i]));
+    if (stop_on_fail && DeepState_StopsReplay(results[i])) {
+      return i + 1;
+    }
+  }
+  return count;
+}
+
+/* Returns the directory in `FLAGS_input_test_dir` that holds the saved test
+ * cases for `test`. The caller must free the path. */
+static char *DeepState_SavedCasesDirForTest(struct DeepState_TestInfo *test) {
   const char *test_file_name = basename((char *) test->file_name);
 
   size_t test_case_dir_len = 3 + strlen(FLAGS_input_test_dir)
@@ -860,8 +1540,15 @@ static int DeepState_RunSavedCasesForTest(struct DeepState_TestInfo *test) {
   }
   snprintf(test_case_dir, test_case_dir_len, "%s/%s/%s",
            FLAGS_input_test_dir, test_file_name, test->test_name);
+  return test_case_dir;
+}
+
+/* Run a single test many times, initialized against each saved test case in
+ * `FLAGS_input_test_dir`. */
+static int DeepState_RunSavedCasesForTest(struct DeepState_TestInfo *test) {
+  int num_failed_tests = 0;
+  char *test_case_dir = DeepState_SavedCasesDirForTest(test);
 
-  struct dirent *dp;
   DIR *dir_fd;
 
   dir_fd = opendir(test_case_dir);
@@ -873,21 +1560,30 @@ static int DeepState_RunSavedCasesForTest(struct DeepState_TestInfo *test) {
     return 0;
   }
 
-  unsigned int i = 0;
-
   /* Read generated test cases and run a test for each file found. */
-  while ((dp = readdir(dir_fd)) != NULL) {
-    if (DeepState_IsTestCaseFile(dp->d_name)) {
-      i++;
-      enum DeepState_TestRunResult result =
-        DeepState_RunSavedTestCase(test, test_case_dir, dp->d_name);
+  struct DeepState_SavedTestCase *cases = NULL;
+  uint32_t count = 0;
+  uint32_t capacity = 0;
+  DeepState_ListSavedTestCases(test, test_case_dir, dir_fd, false, &cases,
+                               &count, &capacity);
+  closedir(dir_fd);
 
-      if (result != DeepState_TestRunPass) {
-        num_failed_tests++;
-      }
+  enum DeepState_TestRunResult *results = (enum DeepState_TestRunResult *)
+      malloc((count + 1) * sizeof(enum DeepState_TestRunResult));
+  if (results == NULL) {
+    DeepState_Abandon("Error allocating memory");
+  }
+
+  unsigned int i = DeepState_RunSavedTestCaseList(cases, count, results,
+                                                  false);
+  for (unsigned int j = 0; j < i; j++) {
+    if (results[j] != DeepState_TestRunPass) {
+      num_failed_tests++;
     }
   }
-  closedir(dir_fd);
+
+  free(results);
+  DeepState_FreeSavedTestCases(cases, count);
   free(test_case_dir);
 
   DeepState_LogFormat(DeepState_LogInfo, "Ran %u tests for %s; %d tests failed",
@@ -1012,11 +1708,8 @@ static int DeepState_RunSingleSavedTestDir(void) {
     return 0;
   }
 
-  struct dirent *dp;
   DIR *dir_fd;
 
-  struct stat path_stat;
-
   dir_fd = opendir(FLAGS_input_test_files_dir);
   if (dir_fd == NULL) {
     DeepState_LogFormat(DeepState_LogInfo,
@@ -1024,32 +1717,37 @@ static int DeepState_RunSingleSavedTestDir(void) {
     return 0;
   }
 
-  unsigned int i = 0;
-
   /* Read generated test cases and run a test for each file found. */
-  while ((dp = readdir(dir_fd)) != NULL) {
-    size_t path_len = 2 + sizeof(char) * (strlen(FLAGS_input_test_files_dir) + strlen(dp->d_name));
-    char *path = (char *) malloc(path_len);
-    snprintf(path, path_len, "%s/%s", FLAGS_input_test_files_dir, dp->d_name);
-    stat(path, &path_stat);
-
-    if (S_ISREG(path_stat.st_mode)) {
-      i++;
-      enum DeepState_TestRunResult result =
-        DeepState_RunSavedTestCase(test, FLAGS_input_test_files_dir, dp->d_name);
-
-      if ((result == DeepState_TestRunFail) || (result == DeepState_TestRunCrash)) {
-        if (FLAGS_abort_on_fail) {
-          DeepState_HardCrash();
-        }
-        if (FLAGS_exit_on_fail) {
-          exit(255); // Terminate the testing
-        }
-        num_failed_tests++;
+  struct DeepState_SavedTestCase *cases = NULL;
+  uint32_t count = 0;
+  uint32_t capacity = 0;
+  DeepState_ListSavedTestCases(test, FLAGS_input_test_files_dir, dir_fd, true,
+                               &cases, &count, &capacity);
+  closedir(dir_fd);
+
+  enum DeepState_TestRunResult *results = (enum DeepState_TestRunResult *)
+      malloc((count + 1) * sizeof(enum DeepState_TestRunResult));
+  if (results == NULL) {
+    DeepState_Abandon("Error allocating memory");
+  }
+
+  unsigned int i = DeepState_RunSavedTestCaseList(cases, count, results,
+                                                  true);
+  for (unsigned int j = 0; j < i; j++) {
+    if ((results[j] == DeepState_TestRunFail) ||
+        (results[j] == DeepState_TestRunCrash)) {
+      if (FLAGS_abort_on_fail) {
+        DeepState_HardCrash();
       }
+      if (FLAGS_exit_on_fail) {
+        exit(255); // Terminate the testing
+      }
+      num_failed_tests++;
     }
   }
-  closedir(dir_fd);
+
+  free(results);
+  DeepState_FreeSavedTestCases(cases, count);
 
   DeepState_LogFormat(DeepState_LogInfo, "Ran %u tests; %d tests failed",
 		      i, num_failed_tests);
@@ -1057,6 +1755,80 @@ static int DeepState_RunSingleSavedTestDir(void) {
   return num_failed_tests;
 }
 
+/* Run every test against each of its saved test cases in
+ * `FLAGS_input_test_dir`, using a single queue of test cases shared by
+ * `FLAGS_num_workers` worker processes. */
+static int DeepState_RunSavedCasesInWorkers(void) {
+  int num_failed_tests = 0;
+  struct DeepState_TestInfo *test = NULL;
+  unsigned num_tests = 0;
+
+  for (test = DeepState_FirstTest(); test != NULL; test = test->prev) {
+    num_tests++;
+  }
+
+  char **test_case_dirs = (char **) malloc((num_tests + 1) * sizeof(char *));
+  if (test_case_dirs == NULL) {
+    DeepState_Abandon("Error allocating memory");
+  }
+
+  struct DeepState_SavedTestCase *cases = NULL;
+  uint32_t count = 0;
+  uint32_t capacity = 0;
+  unsigned t = 0;
+
+  for (test = DeepState_FirstTest(); test != NULL; test = test->prev, t++) {
+    test_case_dirs[t] = DeepState_SavedCasesDirForTest(test);
+    DIR *dir_fd = opendir(test_case_dirs[t]);
+    if (dir_fd == NULL) {
+      DeepState_LogFormat(DeepState_LogInfo,
+                          "Skipping test `%s`, no saved test cases",
+                          test->test_name);
+      continue;
+    }
+    if (!DeepState_ListSavedTestCases(test, test_case_dirs[t], dir_fd, false,
+                                      &cases, &count, &capacity)) {
+      DeepState_LogFormat(DeepState_LogInfo,
+                          "Ran 0 tests for %s; 0 tests failed",
+                          test->test_name);
+    }
+    closedir(dir_fd);
+  }
+
+  enum DeepState_TestRunResult *results = (enum DeepState_TestRunResult *)
+      malloc((count + 1) * sizeof(enum DeepState_TestRunResult));
+  if (results == NULL) {
+    DeepState_Abandon("Error allocating memory");
+  }
+
+  DeepState_RunSavedTestCaseList(cases, count, results, false);
+
+  /* The test cases of each test are next to each other in the queue. */
+  for (uint32_t j = 0; j < count; ) {
+    test = cases[j].test;
+    unsigned int i = 0;
+    int num_failed = 0;
+    for (; j < count && cases[j].test == test; j++, i++) {
+      if (results[j] != DeepState_TestRunPass) {
+        num_failed++;
+      }
+    }
+    DeepState_LogFormat(DeepState_LogInfo,
+                        "Ran %u tests for %s; %d tests failed",
+                        i, test->test_name, num_failed);
+    num_failed_tests += num_failed;
+  }
+
+  free(results);
+  DeepState_FreeSavedTestCases(cases, count);
+  for (t = 0; t < num_tests; t++) {
+    free(test_case_dirs[t]);
+  }
+  free(test_case_dirs);
+
+  return num_failed_tests;
+}
+
 /* Run test `FLAGS_input_which_test` with saved input from `FLAGS_input_test_file`.
  *
  * For each test unit and case, see if there are input files in the
@@ -1070,8 +1842,12 @@ static int DeepState_RunSavedTestCases(void) {
     FLAGS_min_log_level = 2;
   }
 
-  for (test = DeepState_FirstTest(); test != NULL; test = test->prev) {
-    num_failed_tests += DeepState_RunSavedCasesForTest(test);
+  if (FLAGS_num_workers > 1) {
+    num_failed_tests = DeepState_RunSavedCasesInWorkers();
+  } else {
+    for (test = DeepState_FirstTest(); test != NULL; test = test->prev) {
+      num_failed_tests += DeepState_RunSavedCasesForTest(test);
+    }
   }
 
   DeepState_Teardown();
@@ -1085,6 +1861,10 @@ static int DeepState_Run(void) {
     DeepState_Abandon("Please call DeepState_InitOptions(argc, argv) in main");
   }
 
+  if (HAS_FLAG_max_input_size) {
+    DeepState_SetInputSize(FLAGS_max_input_size);
+  }
+
   if (HAS_FLAG_list_tests) {
 	return DeepState_RunListTests();
   }
@@ -1109,6 +1889,12 @@ static int DeepState_Run(void) {
   int use_drfuzz = getenv("DYNAMORIO_EXE_PATH") != NULL;
   struct DeepState_TestInfo *test = NULL;
 
+  /* With several workers, queue the tests up to run them in parallel. */
+  int use_workers = FLAGS_num_workers > 1 && !use_drfuzz;
+  struct DeepState_SavedTestCase *queued = NULL;
+  uint32_t num_queued = 0;
+  uint32_t capacity = 0;
+
 
   for (test = DeepState_FirstTest(); test != NULL; test = test->prev) {
 
@@ -1117,10 +1903,15 @@ static int DeepState_Run(void) {
 	/* Run only the Boring* tests */
 	if (HAS_FLAG_boring_only) {
 	  if (strstr(curr_test, "Boring") || strstr(curr_test, "BORING")) {
-        DeepState_Begin(test);
-		if (DeepState_ForkAndRunTest(test) != 0) {
-		  num_failed_tests++;
-		}
+        if (use_workers) {
+          DeepState_AddQueuedTest(&queued, &num_queued, &capacity, test,
+                                  NULL, NULL);
+        } else {
+          DeepState_Begin(test);
+          if (DeepState_ForkAndRunTest(test) != 0) {
+            num_failed_tests++;
+          }
+        }
 	  } else {
 		continue;
 	  }
@@ -1147,6 +1938,9 @@ static int DeepState_Run(void) {
       } else {
         continue;
       }
+    } else if (use_workers) {
+      DeepState_AddQueuedTest(&queued, &num_queued, &capacity, test,
+                              NULL, NULL);
     } else {
 	  DeepState_Begin(test);
       if (DeepState_ForkAndRunTest(test) != 0) {
@@ -1159,6 +1953,22 @@ static int DeepState_Run(void) {
     waitpid(-1, NULL, 0);  /* Wait for all children. */
   }
 
+  if (num_queued) {
+    enum DeepState_TestRunResult *results = (enum DeepState_TestRunResult *)
+        malloc(num_queued * sizeof(enum DeepState_TestRunResult));
+    if (results == NULL) {
+      DeepState_Abandon("Error allocating memory");
+    }
+    DeepState_RunSavedTestCaseList(queued, num_queued, results, false);
+    for (uint32_t i = 0; i < num_queued; i++) {
+      if (results[i] != DeepState_TestRunPass) {
+        num_failed_tests++;
+      }
+    }
+    free(results);
+    DeepState_FreeSavedTestCases(queued, num_queued);
+  }
+
   DeepState_Teardown();
 
   return num_failed_tests;
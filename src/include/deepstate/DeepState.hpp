@@ -20,7 +20,11 @@
 #include <deepstate/DeepState.h>
 #include <deepstate/Stream.hpp>
 
+#include <algorithm>
+#include <deque>
 #include <functional>
+#include <map>
+#include <set>
 #include <string>
 #include <type_traits>
 #include <utility>
@@ -153,21 +157,162 @@ class Symbolic {
 template <typename T>
 class Symbolic<T &> {};
 
+// Most elements in a container made by `Symbolic<Container>`, unless the
+// sizes it can have are given.
+#ifndef DEEPSTATE_MAX_CONTAINER_SIZE
+#define DEEPSTATE_MAX_CONTAINER_SIZE 32
+#endif
+
+// Pick the number of elements of a symbolic container.
+DEEPSTATE_INLINE static size_t SymbolicContainerSize(size_t min_size,
+                                                     size_t max_size) {
+  return DeepState_SizeInRange(min_size, max_size);
+}
+
+// Generates the elements of symbolic containers, one at a time, by way of
+// `Symbolic<T>`.
+template <typename T, typename Enable = void>
+struct SymbolicElements {
+  DEEPSTATE_INLINE static T One(void) {
+    return static_cast<T>(Symbolic<T>());
+  }
+
+  template <typename Iter>
+  DEEPSTATE_INLINE static void Fill(Iter elems, size_t num_elems) {
+    for (size_t i = 0; i < num_elems; ++i, ++elems) {
+      *elems = One();
+    }
+  }
+};
+
+template <>
+struct SymbolicElements<bool> {
+  DEEPSTATE_INLINE static bool One(void) {
+    return static_cast<bool>(DeepState_Bool());
+  }
+
+  template <typename Iter>
+  DEEPSTATE_INLINE static void Fill(Iter elems, size_t num_elems) {
+    for (size_t i = 0; i < num_elems; ++i, ++elems) {
+      *elems = One();
+    }
+  }
+};
+
+// Integers and floating-point numbers, which any bytes make a valid value of,
+// are read in bulk: all of a container's elements with one read of input.
+// Other types, such as enums and user types, go through `Symbolic<T>`.
+template <typename T>
+struct SymbolicElements<T, typename std::enable_if<
+    std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>::type> {
+  DEEPSTATE_INLINE static T One(void) {
+    T elem;
+    DeepState_SymbolizeData(&elem, &elem + 1);
+    return elem;
+  }
+
+  DEEPSTATE_INLINE static void Fill(T *elems, size_t num_elems) {
+    DeepState_SymbolizeData(elems, elems + num_elems);
+  }
+
+  template <typename Iter>
+  DEEPSTATE_INLINE static void Fill(Iter elems, size_t num_elems) {
+    std::vector<T> buffer(num_elems);
+    Fill(buffer.data(), num_elems);
+    std::copy(buffer.begin(), buffer.end(), elems);
+  }
+};
+
+// Fill in the elements of a sequence container, in place where they are
+// contiguous.
+template <typename T>
+DEEPSTATE_INLINE static void SymbolizeElements(T &container) {
+  SymbolicElements<typename T::value_type>::Fill(container.begin(),
+                                                 container.size());
+}
+
+template <typename T, typename Alloc>
+DEEPSTATE_INLINE static void SymbolizeElements(std::vector<T, Alloc> &vec) {
+  if (!vec.empty()) {
+    SymbolicElements<T>::Fill(&(vec[0]), vec.size());
+  }
+}
+
+template <typename Alloc>
+DEEPSTATE_INLINE static void SymbolizeElements(std::vector<bool, Alloc> &vec) {
+  SymbolicElements<bool>::Fill(vec.begin(), vec.size());
+}
+
+template <typename T, typename Traits, typename Alloc>
+DEEPSTATE_INLINE static void SymbolizeElements(
+    std::basic_string<T, Traits, Alloc> &str) {
+  if (!str.empty()) {
+    SymbolicElements<T>::Fill(&(str[0]), str.size());
+  }
+}
+
+// Insert `num_elems` symbolic elements into an associative container. Keys
+// are generated first, then values, each in bulk where possible.
+template <typename T, typename Compare, typename Alloc>
+DEEPSTATE_INLINE static void InsertSymbolicElements(
+    std::set<T, Compare, Alloc> &set, size_t num_elems) {
+  std::vector<T> keys(num_elems);
+  SymbolizeElements(keys);
+  set.insert(keys.begin(), keys.end());
+}
+
+template <typename K, typename V, typename Compare, typename Alloc>
+DEEPSTATE_INLINE static void InsertSymbolicElements(
+    std::map<K, V, Compare, Alloc> &map, size_t num_elems) {
+  std::vector<K> keys(num_elems);
+  std::vector<V> values(num_elems);
+  SymbolizeElements(keys);
+  SymbolizeElements(values);
+  for (size_t i = 0; i < num_elems; ++i) {
+    map.emplace(std::move(keys[i]), std::move(values[i]));
+  }
+}
+
+// A symbolic `std::vector`, `std::deque` or string, of `len` elements, or
+// of between `min_len` and `max_len` elements.
 template <typename T>
 class SymbolicLinearContainer {
  public:
-  DEEPSTATE_INLINE explicit SymbolicLinearContainer(size_t len)
-      : value(len) {
-    if (!value.empty()) {
-      DeepState_SymbolizeData(&(value.front()), &(value.back()));
-    }
+  DEEPSTATE_INLINE explicit SymbolicLinearContainer(size_t len) {
+    value.resize(len);
+    SymbolizeElements(value);
   }
 
-  DEEPSTATE_INLINE SymbolicLinearContainer(void) {
-    value.reserve(32);
-    value.resize(DeepState_SizeInRange(0, 32));  // Avoids symbolic `malloc`.
+  DEEPSTATE_INLINE SymbolicLinearContainer(size_t min_len, size_t max_len)
+      : SymbolicLinearContainer(SymbolicContainerSize(min_len, max_len)) {}
+
+  DEEPSTATE_INLINE SymbolicLinearContainer(void)
+      : SymbolicLinearContainer(0, DEEPSTATE_MAX_CONTAINER_SIZE) {}
+
+  DEEPSTATE_INLINE operator T (void) const {
+    return value;
   }
 
+  T value;
+};
+
+// A symbolic `std::set` or `std::map`. It has fewer than the number of
+// elements asked for when generated keys repeat.
+template <typename T>
+class SymbolicAssociativeContainer {
+ public:
+  DEEPSTATE_INLINE explicit SymbolicAssociativeContainer(size_t len) {
+    InsertSymbolicElements(value, len);
+  }
+
+  DEEPSTATE_INLINE SymbolicAssociativeContainer(size_t min_len,
+                                                size_t max_len)
+      : SymbolicAssociativeContainer(
+            SymbolicContainerSize(min_len, max_len)) {}
+
+  DEEPSTATE_INLINE SymbolicAssociativeContainer(void)
+      : SymbolicAssociativeContainer(0, DEEPSTATE_MAX_CONTAINER_SIZE) {}
+
   DEEPSTATE_INLINE operator T (void) const {
     return value;
   }
@@ -187,7 +332,29 @@ class Symbolic<std::wstring> : public SymbolicLinearContainer<std::wstring> {
 
 template <typename T>
 class Symbolic<std::vector<T>> :
-    public SymbolicLinearContainer<std::vector<T>> {};
+    public SymbolicLinearContainer<std::vector<T>> {
+  using SymbolicLinearContainer<std::vector<T>>::SymbolicLinearContainer;
+};
+
+template <typename T>
+class Symbolic<std::deque<T>> :
+    public SymbolicLinearContainer<std::deque<T>> {
+  using SymbolicLinearContainer<std::deque<T>>::SymbolicLinearContainer;
+};
+
+template <typename T>
+class Symbolic<std::set<T>> :
+    public SymbolicAssociativeContainer<std::set<T>> {
+  using SymbolicAssociativeContainer<std::set<T>>::
+      SymbolicAssociativeContainer;
+};
+
+template <typename K, typename V>
+class Symbolic<std::map<K, V>> :
+    public SymbolicAssociativeContainer<std::map<K, V>> {
+  using SymbolicAssociativeContainer<std::map<K, V>>::
+      SymbolicAssociativeContainer;
+};
 
 #define MAKE_SYMBOL_SPECIALIZATION(Tname, tname) \
     template <> \
@@ -349,34 +516,61 @@ inline static void ForAll(Closure func) {
 #define OneOf(...) _SwarmOneOf(__FILE__, __LINE__, DeepState_SwarmTypeProb, __VA_ARGS__)
 #endif
 
+// Call `func`, given its address.
+template <typename FuncTy>
+DEEPSTATE_INLINE static void CallOneOfFunc(void *func) {
+  (*static_cast<typename std::remove_reference<FuncTy>::type *>(func))();
+}
+
+// Call the `index`th of `funcs`, through a table of calls made at compile
+// time for their types. The functions are neither copied nor wrapped.
+template <typename... FuncTys>
+DEEPSTATE_INLINE static void CallOneOf(unsigned index, FuncTys&&... funcs) {
+  static void (* const callers[])(void *) = {&CallOneOfFunc<FuncTys>...};
+  void *func_ptrs[] = {
+      const_cast<void *>(static_cast<const void *>(&funcs))...};
+  callers[index](func_ptrs[index]);
+}
+
+// `Pump` a choice of one of `num_choices` alternatives when it may be
+// symbolic; a concrete choice is returned as is.
+DEEPSTATE_INLINE static unsigned PumpChoice(unsigned index,
+                                            unsigned num_choices) {
+  return DeepState_UsingSymExec ? Pump(index, num_choices) : index;
+}
+
 template <typename... FuncTys>
 inline static void NoSwarmOneOf(FuncTys&&... funcs) {
   if (FLAGS_verbose_reads) {
     printf("STARTING OneOf CALL\n");
   }
-  std::function<void(void)> func_arr[sizeof...(FuncTys)] = {funcs...};
+  DeepState_TraceInput(DeepState_TraceOneOfBegin, DeepState_TraceBytes, 0, 0);
   unsigned index = DeepState_UIntInRange(
       0U, static_cast<unsigned>(sizeof...(funcs))-1);
-  func_arr[Pump(index, sizeof...(funcs))]();
+  CallOneOf(PumpChoice(index, sizeof...(funcs)),
+            std::forward<FuncTys>(funcs)...);
   if (FLAGS_verbose_reads) {
     printf("FINISHED OneOf CALL\n");
   }
+  DeepState_TraceInput(DeepState_TraceOneOfEnd, DeepState_TraceBytes, 0, 0);
 }
 
 template <typename... FuncTys>
 inline static void _SwarmOneOf(const char* file, unsigned line, enum DeepState_SwarmType stype,
 			       FuncTys&&... funcs) {
   unsigned fcount = static_cast<unsigned>(sizeof...(funcs));
-  std::function<void(void)> func_arr[sizeof...(FuncTys)] = {funcs...};
   struct DeepState_SwarmConfig* sc = DeepState_GetSwarmConfig(fcount, file, line, stype);
   if (FLAGS_verbose_reads) {
     printf("STARTING OneOf CALL\n");
   }
+  DeepState_TraceInput(DeepState_TraceOneOfBegin, DeepState_TraceBytes, 0, 0);
   unsigned index = DeepState_UIntInRange(0U, sc->fcount-1);
-  func_arr[sc->fmap[Pump(index, sc->fcount)]]();
+  CallOneOf(sc->fmap[PumpChoice(index, sc->fcount)],
+            std::forward<FuncTys>(funcs)...);
   if (FLAGS_verbose_reads) {
     printf("FINISHED OneOf CALL\n");
   }
+  DeepState_TraceInput(DeepState_TraceOneOfEnd, DeepState_TraceBytes, 0, 0);
 }
 
 inline static char NoSwarmOneOf(const char *str) {
@@ -0,0 +1,473 @@
+/*
+ * Copyright (c) 2019 Trail of Bits, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_INCLUDE_DEEPSTATE_GEN_HPP_
+#define SRC_INCLUDE_DEEPSTATE_GEN_HPP_
+
+#include <deepstate/DeepState.hpp>
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#include <optional>
+#include <variant>
+#endif
+
+// Generator combinators, for building structured inputs out of smaller
+// ones. A generator is any copyable object with a `value_type` and a
+// `value_type operator()(void) const` that draws a value from the input.
+// Combinators take their generators as template parameters, so a generator
+// built out of many compiles down to the same draws as hand-written code.
+//
+// Values made out of several generators (tuples, structs, `ForAll`
+// arguments) draw them from left to right.
+
+namespace deepstate {
+namespace gen {
+namespace detail {
+
+template <size_t... Is>
+struct IndexSequence {};
+
+template <size_t N, size_t... Is>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, Is...> {};
+
+template <size_t... Is>
+struct MakeIndexSequence<0, Is...> {
+  using Type = IndexSequence<Is...>;
+};
+
+template <typename F, typename Tuple, size_t... Is>
+DEEPSTATE_INLINE static auto Apply(F &func, Tuple &&args, IndexSequence<Is...>)
+    -> decltype(func(std::get<Is>(std::forward<Tuple>(args))...)) {
+  return func(std::get<Is>(std::forward<Tuple>(args))...);
+}
+
+// Draw a value of integral type `T` in `[low, high]`, with the
+// `DeepState_*InRange` function of the same size and signedness.
+template <typename T>
+DEEPSTATE_INLINE static
+typename std::enable_if<std::is_integral<T>::value, T>::type
+DrawInRange(T low, T high) {
+  if (sizeof(T) == 1) {
+    return std::is_signed<T>::value ?
+        static_cast<T>(DeepState_CharInRange(low, high)) :
+        static_cast<T>(DeepState_UCharInRange(low, high));
+  } else if (sizeof(T) == 2) {
+    return std::is_signed<T>::value ?
+        static_cast<T>(DeepState_ShortInRange(low, high)) :
+        static_cast<T>(DeepState_UShortInRange(low, high));
+  } else if (sizeof(T) == 4) {
+    return std::is_signed<T>::value ?
+        static_cast<T>(DeepState_IntInRange(low, high)) :
+        static_cast<T>(DeepState_UIntInRange(low, high));
+  } else {
+    return std::is_signed<T>::value ?
+        static_cast<T>(DeepState_Int64InRange(low, high)) :
+        static_cast<T>(DeepState_UInt64InRange(low, high));
+  }
+}
+
+DEEPSTATE_INLINE static float DrawInRange(float low, float high) {
+  return DeepState_FloatInRange(low, high);
+}
+
+DEEPSTATE_INLINE static double DrawInRange(double low, double high) {
+  return DeepState_DoubleInRange(low, high);
+}
+
+// Draw which of `num_choices` choices to take.
+DEEPSTATE_INLINE static unsigned DrawChoice(unsigned num_choices) {
+  return PumpChoice(DeepState_UIntInRange(0U, num_choices - 1),
+                    num_choices);
+}
+
+}  // namespace detail
+
+// Any value of type `T`, made like the elements of `Symbolic` containers.
+template <typename T>
+struct Arbitrary {
+  using value_type = T;
+
+  DEEPSTATE_INLINE T operator()(void) const {
+    return SymbolicElements<T>::One();
+  }
+};
+
+// A value of integral or floating-point type `T` in `[low, high]`.
+template <typename T>
+struct InRangeGen {
+  using value_type = T;
+
+  DEEPSTATE_INLINE T operator()(void) const {
+    return detail::DrawInRange(low, high);
+  }
+
+  T low;
+  T high;
+};
+
+template <typename T>
+DEEPSTATE_INLINE static InRangeGen<T> InRange(T low, T high) {
+  return InRangeGen<T>{low, high};
+}
+
+// A value of enumeration type `E`, from `first` to `last` inclusive.
+template <typename E>
+struct EnumGen {
+  using value_type = E;
+  using Underlying = typename std::underlying_type<E>::type;
+
+  DEEPSTATE_INLINE E operator()(void) const {
+    return static_cast<E>(detail::DrawInRange(
+        static_cast<Underlying>(first), static_cast<Underlying>(last)));
+  }
+
+  E first;
+  E last;
+};
+
+template <typename E>
+DEEPSTATE_INLINE static EnumGen<E> Enum(E first, E last) {
+  return EnumGen<E>{first, last};
+}
+
+// Always `value`, without reading any input.
+template <typename T>
+struct JustGen {
+  using value_type = T;
+
+  DEEPSTATE_INLINE T operator()(void) const {
+    return value;
+  }
+
+  T value;
+};
+
+template <typename T>
+DEEPSTATE_INLINE static JustGen<T> Just(T value) {
+  return JustGen<T>{std::move(value)};
+}
+
+// One of a fixed set of values.
+template <typename T, size_t N>
+struct ElementGen {
+  using value_type = T;
+
+  DEEPSTATE_INLINE T operator()(void) const {
+    return values[detail::DrawChoice(N)];
+  }
+
+  std::array<T, N> values;
+};
+
+template <typename T, typename... Ts>
+DEEPSTATE_INLINE static ElementGen<T, 1 + sizeof...(Ts)> Element(
+    T value, Ts... values) {
+  return ElementGen<T, 1 + sizeof...(Ts)>{
+      {{value, static_cast<T>(values)...}}};
+}
+
+// The value of `gen`, passed through `func`.
+template <typename G, typename F>
+struct MapGen {
+  using value_type =
+      typename std::decay<decltype(std::declval<const F &>()(
+          std::declval<typename G::value_type>()))>::type;
+
+  DEEPSTATE_INLINE value_type operator()(void) const {
+    return func(gen());
+  }
+
+  G gen;
+  F func;
+};
+
+template <typename G, typename F>
+DEEPSTATE_INLINE static MapGen<G, F> Map(G gen, F func) {
+  return MapGen<G, F>{std::move(gen), std::move(func)};
+}
+
+// The value of `gen`, assuming that it satisfies `pred`. Values that don't
+// abandon the test, so prefer generators that only make good values.
+template <typename G, typename P>
+struct FilterGen {
+  using value_type = typename G::value_type;
+
+  DEEPSTATE_INLINE value_type operator()(void) const {
+    value_type value = gen();
+    (void) DeepState_Assume(pred(static_cast<const value_type &>(value)));
+    return value;
+  }
+
+  G gen;
+  P pred;
+};
+
+template <typename G, typename P>
+DEEPSTATE_INLINE static FilterGen<G, P> Filter(G gen, P pred) {
+  return FilterGen<G, P>{std::move(gen), std::move(pred)};
+}
+
+// The value of one of several generators, picked like with `OneOf`.
+template <typename... Gs>
+struct AnyOfGen {
+  using value_type =
+      typename std::common_type<typename Gs::value_type...>::type;
+
+  DEEPSTATE_INLINE value_type operator()(void) const {
+    if (FLAGS_verbose_reads) {
+      printf("STARTING OneOf CALL\n");
+    }
+    DeepState_TraceInput(DeepState_TraceOneOfBegin, DeepState_TraceBytes,
+                         0, 0);
+    value_type value = Pick(detail::DrawChoice(sizeof...(Gs)),
+                            std::integral_constant<size_t, 0>());
+    if (FLAGS_verbose_reads) {
+      printf("FINISHED OneOf CALL\n");
+    }
+    DeepState_TraceInput(DeepState_TraceOneOfEnd, DeepState_TraceBytes,
+                         0, 0);
+    return value;
+  }
+
+  template <size_t I>
+  DEEPSTATE_INLINE value_type Pick(
+      unsigned index, std::integral_constant<size_t, I>) const {
+    if (index == I) {
+      return std::get<I>(gens)();
+    }
+    return Pick(index, std::integral_constant<size_t, I + 1>());
+  }
+
+  DEEPSTATE_INLINE value_type Pick(
+      unsigned, std::integral_constant<size_t, sizeof...(Gs) - 1>) const {
+    return std::get<sizeof...(Gs) - 1>(gens)();
+  }
+
+  std::tuple<Gs...> gens;
+};
+
+template <typename... Gs>
+DEEPSTATE_INLINE static AnyOfGen<Gs...> AnyOf(Gs... gens) {
+  static_assert(sizeof...(Gs) > 0, "AnyOf needs at least one generator");
+  return AnyOfGen<Gs...>{std::tuple<Gs...>(std::move(gens)...)};
+}
+
+// A `T` constructed from the values of `gens`, e.g. a struct from a value
+// for each of its fields.
+template <typename T, typename... Gs>
+struct ConstructGen {
+  using value_type = T;
+
+  DEEPSTATE_INLINE T operator()(void) const {
+    return Make(typename detail::MakeIndexSequence<sizeof...(Gs)>::Type());
+  }
+
+  template <size_t... Is>
+  DEEPSTATE_INLINE T Make(detail::IndexSequence<Is...>) const {
+    return T{std::get<Is>(gens)()...};
+  }
+
+  std::tuple<Gs...> gens;
+};
+
+template <typename T, typename... Gs>
+DEEPSTATE_INLINE static ConstructGen<T, Gs...> Construct(Gs... gens) {
+  return ConstructGen<T, Gs...>{std::tuple<Gs...>(std::move(gens)...)};
+}
+
+// A `std::tuple` of the values of `gens`.
+template <typename... Gs>
+DEEPSTATE_INLINE static
+ConstructGen<std::tuple<typename Gs::value_type...>, Gs...> Tuple(
+    Gs... gens) {
+  return Construct<std::tuple<typename Gs::value_type...>>(
+      std::move(gens)...);
+}
+
+// A `std::vector` of between `min_size` and `max_size` values of `gen`.
+template <typename G>
+struct VectorOfGen {
+  using value_type = std::vector<typename G::value_type>;
+
+  DEEPSTATE_INLINE value_type operator()(void) const {
+    value_type values;
+    size_t size = SymbolicContainerSize(min_size, max_size);
+    values.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+      values.push_back(gen());
+    }
+    return values;
+  }
+
+  G gen;
+  size_t min_size;
+  size_t max_size;
+};
+
+// Vectors of arbitrary values are filled like `Symbolic` containers, all at
+// once where the type allows.
+template <typename T>
+struct VectorOfGen<Arbitrary<T>> {
+  using value_type = std::vector<T>;
+
+  DEEPSTATE_INLINE value_type operator()(void) const {
+    return Symbolic<value_type>(min_size, max_size);
+  }
+
+  Arbitrary<T> gen;
+  size_t min_size;
+  size_t max_size;
+};
+
+template <typename G>
+DEEPSTATE_INLINE static VectorOfGen<G> VectorOf(
+    G gen, size_t min_size = 0,
+    size_t max_size = DEEPSTATE_MAX_CONTAINER_SIZE) {
+  return VectorOfGen<G>{std::move(gen), min_size, max_size};
+}
+
+#if __cplusplus >= 201703L
+
+// A `std::optional` that holds a value of `gen` half of the time.
+template <typename G>
+struct OptionalGen {
+  using value_type = std::optional<typename G::value_type>;
+
+  DEEPSTATE_INLINE value_type operator()(void) const {
+    if (DeepState_Bool()) {
+      return gen();
+    }
+    return std::nullopt;
+  }
+
+  G gen;
+};
+
+template <typename G>
+DEEPSTATE_INLINE static OptionalGen<G> Optional(G gen) {
+  return OptionalGen<G>{std::move(gen)};
+}
+
+// A `std::variant` holding the value of one of `gens`, picked like with
+// `OneOf`.
+template <typename... Gs>
+struct VariantGen {
+  using value_type = std::variant<typename Gs::value_type...>;
+
+  DEEPSTATE_INLINE value_type operator()(void) const {
+    return Pick(detail::DrawChoice(sizeof...(Gs)),
+                std::integral_constant<size_t, 0>());
+  }
+
+  template <size_t I>
+  DEEPSTATE_INLINE value_type Pick(
+      unsigned index, std::integral_constant<size_t, I>) const {
+    if constexpr (I + 1 < sizeof...(Gs)) {
+      if (index != I) {
+        return Pick(index, std::integral_constant<size_t, I + 1>());
+      }
+    }
+    return value_type(std::in_place_index<I>, std::get<I>(gens)());
+  }
+
+  std::tuple<Gs...> gens;
+};
+
+template <typename... Gs>
+DEEPSTATE_INLINE static VariantGen<Gs...> Variant(Gs... gens) {
+  return VariantGen<Gs...>{std::tuple<Gs...>(std::move(gens)...)};
+}
+
+#endif  // __cplusplus >= 201703L
+
+// Passed to the function of a `Recursive` generator, to make the values
+// nested in the one it makes. Calling it makes one, a level deeper.
+template <typename T>
+class Recurse {
+ public:
+  DEEPSTATE_INLINE Recurse(T (*make_)(const void *, unsigned),
+                           const void *gen_, unsigned depth_left_)
+      : make(make_),
+        gen(gen_),
+        depth_left(depth_left_) {}
+
+  // Can values be nested any deeper? Past the maximum depth, the function
+  // has to make a value without calling this `Recurse`.
+  DEEPSTATE_INLINE bool CanRecurse(void) const {
+    return depth_left > 0;
+  }
+
+  DEEPSTATE_INLINE unsigned DepthLeft(void) const {
+    return depth_left;
+  }
+
+  DEEPSTATE_INLINE T operator()(void) const {
+    if (!depth_left) {
+      DeepState_Abandon("Recursive generator nested past its maximum depth");
+    }
+    return make(gen, depth_left - 1);
+  }
+
+ private:
+  T (*make)(const void *, unsigned);
+  const void *gen;
+  unsigned depth_left;
+};
+
+// A value of a recursive type `T`, e.g. a tree, made by `func` from a
+// `Recurse<T>`, nested at most `max_depth` levels deep.
+template <typename T, typename F>
+struct RecursiveGen {
+  using value_type = T;
+
+  DEEPSTATE_INLINE T operator()(void) const {
+    return Make(this, max_depth);
+  }
+
+  static T Make(const void *gen, unsigned depth_left) {
+    const RecursiveGen *self = static_cast<const RecursiveGen *>(gen);
+    return self->func(Recurse<T>(&RecursiveGen::Make, gen, depth_left));
+  }
+
+  F func;
+  unsigned max_depth;
+};
+
+template <typename T, typename F>
+DEEPSTATE_INLINE static RecursiveGen<T, F> Recursive(unsigned max_depth,
+                                                     F func) {
+  return RecursiveGen<T, F>{std::move(func), max_depth};
+}
+
+// Call `func` with a value of each of `gens`.
+template <typename F, typename... Gs>
+DEEPSTATE_INLINE static void ForAll(F func, Gs... gens) {
+  std::tuple<typename Gs::value_type...> args{gens()...};
+  detail::Apply(func, std::move(args),
+                typename detail::MakeIndexSequence<sizeof...(Gs)>::Type());
+}
+
+}  // namespace gen
+}  // namespace deepstate
+
+#endif  // SRC_INCLUDE_DEEPSTATE_GEN_HPP_
@@ -55,6 +55,39 @@ extern void DeepState_LogFormat(enum DeepState_LogLevel level,
 extern void DeepState_LogVFormat(enum DeepState_LogLevel level,
                                  const char *format, va_list args);
 
+/* Start holding back the messages of a test, if `--defer_log` is set. They
+ * are written out if the test fails, and thrown away otherwise. */
+extern void DeepState_HoldLog(void);
+
+/* Write out the messages held back so far, and stop holding them back. */
+extern void DeepState_FlushLog(void);
+
+/* Throw away the messages held back so far, and stop holding them back. */
+extern void DeepState_DropLog(void);
+
+/* Where the messages of a test are held back. */
+struct DeepState_LogRing;
+
+/* Map a ring into memory that is shared with the processes forked from now
+ * on. Returns `NULL` if messages aren't held back, or if it can't be
+ * mapped. */
+extern struct DeepState_LogRing *DeepState_NewSharedLog(void);
+
+/* Unmap a ring from `DeepState_NewSharedLog`. */
+extern void DeepState_FreeSharedLog(struct DeepState_LogRing *ring);
+
+/* Hold back the messages of this process, and of the tests it forks, in
+ * `ring`, or in a ring of its own if `ring` is `NULL`. */
+extern void DeepState_UseLog(struct DeepState_LogRing *ring);
+
+/* Make sure that the tests this process forks hold their messages in a ring
+ * that it shares with them. */
+extern void DeepState_ShareLog(void);
+
+/* Write out the messages that a process holding them in `ring` (or in this
+ * process's ring, if `ring` is `NULL`) held back before it died. */
+extern void DeepState_FlushDeadLog(struct DeepState_LogRing *ring);
+
 DEEPSTATE_END_EXTERN_C
 
 #endif  /* SRC_INCLUDE_DEEPSTATE_LOG_H_ */
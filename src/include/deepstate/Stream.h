@@ -42,6 +42,10 @@ extern void DeepState_StreamCStr(enum DeepState_LogLevel level,
 /*extern void DeepState_StreamData(
     enum DeepState_LogLevel level, const void *begin, const void *end); */
 
+/* Stream the location of a message in the source, as `file(line): `. */
+extern void DeepState_StreamLocation(enum DeepState_LogLevel level,
+                                     const char *file, unsigned line);
+
 /* Stream some formatted input */
 extern void DeepState_StreamFormat(
     enum DeepState_LogLevel level, const char *format, ...);
@@ -79,6 +83,9 @@ DEEPSTATE_INLINE static void DeepState_StreamFloat(
 /* Reset the formatting in a stream. */
 extern void DeepState_StreamResetFormatting(enum DeepState_LogLevel level);
 
+/* Clear the contents and formatting of every stream. */
+extern void DeepState_ResetStreams(void);
+
 DEEPSTATE_END_EXTERN_C
 
 #endif  /* SRC_INCLUDE_DEEPSTATE_STREAM_H_ */
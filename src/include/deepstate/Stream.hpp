@@ -24,17 +24,18 @@
 
 namespace deepstate {
 
-/* Conditionally stream output to a log using the streaming APIs. */
+/* Conditionally stream output to a log using the streaming APIs. Nothing is
+ * formatted unless the condition holds and the level is being logged. */
 class Stream {
  public:
   DEEPSTATE_INLINE Stream(DeepState_LogLevel level_, bool do_log_,
                           const char *file, unsigned line)
       : level(level_),
-        do_log(!!DeepState_IsTrue(do_log_)),
+        do_log(ShouldLog(level_, do_log_)),
         has_something_to_log(false) {
-    DeepState_LogStream(level);
     if (do_log) {
-      DeepState_StreamFormat(level, "%s(%u): ", file, line);
+      DeepState_LogStream(level);
+      DeepState_StreamLocation(level, file, line);
     }
   }
 
@@ -95,6 +96,14 @@ class Stream {
   // TODO(pag): Implement a `std::wstring` streamer.
 
  private:
+  DEEPSTATE_INLINE static bool ShouldLog(DeepState_LogLevel level,
+                                         bool do_log) {
+    if (DEEPSTATE_UNLIKELY(DeepState_UsingSymExec)) {
+      return !!DeepState_IsTrue(do_log);
+    }
+    return do_log && DeepState_LogLevelEnabled(level);
+  }
+
   Stream(void) = delete;
   Stream(const Stream &) = delete;
   Stream &operator=(const Stream &) = delete;
@@ -19,11 +19,29 @@
 #include "deepstate/Log.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
 #include <limits.h>
 #include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#if defined(__SANITIZE_ADDRESS__)
+#define DEEPSTATE_ARENA_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define DEEPSTATE_ARENA_ASAN 1
+#endif
+#endif
+
+#ifdef DEEPSTATE_ARENA_ASAN
+#include <sanitizer/asan_interface.h>
+#else
+#define ASAN_POISON_MEMORY_REGION(addr, size) ((void) (addr), (void) (size))
+#define ASAN_UNPOISON_MEMORY_REGION(addr, size) ((void) (addr), (void) (size))
+#endif
+
 #ifdef DEEPSTATE_TAKEOVER_RAND
 #undef rand
 #undef srand
@@ -36,20 +54,26 @@ DEFINE_string(input_test_dir, InputOutputGroup, "", "Directory of saved tests to
 DEFINE_string(input_test_file, InputOutputGroup, "", "Saved test to run.");
 DEFINE_string(input_test_files_dir, InputOutputGroup, "", "Directory of saved test files to run (flat structure).");
 DEFINE_string(output_test_dir, InputOutputGroup, "", "Directory where tests will be saved.");
+DEFINE_uint(max_input_size, InputOutputGroup, DEEPSTATE_SIZE, "Maximum number of input bytes a test can consume.");
 
 /* Test execution-related options, configures how an execution run is carried out */
 DEFINE_bool(take_over, ExecutionGroup, false, "Replay test cases in take-over mode.");
 DEFINE_bool(abort_on_fail, ExecutionGroup, false, "Abort on file replay failure (useful in file fuzzing).");
 DEFINE_bool(exit_on_fail, ExecutionGroup, false, "Exit with status 255 on test failure.");
 DEFINE_bool(verbose_reads, ExecutionGroup, false, "Report on bytes being read during execution of test.");
+DEFINE_bool(defer_log, ExecutionGroup, false, "Hold back the log of each test, and only write it out if the test fails.");
+DEFINE_string(trace_reads, ExecutionGroup, "", "Write a binary trace of the input read by each test to this file.");
+DEFINE_string(input_exhaustion, ExecutionGroup, "abandon", "What reads past the end of the input get: abandon (the test), zero, or extend (with bytes generated from the input).");
 DEFINE_int(min_log_level, ExecutionGroup, 0, "Minimum level of logging to output (default 2, 0=debug, 1=trace, 2=info, ...).");
 DEFINE_int(timeout, ExecutionGroup, 120, "Timeout for brute force fuzzing.");
 DEFINE_uint(num_workers, ExecutionGroup, 1, "Number of workers to spawn for testing and test generation.");
+DEFINE_uint(persistent_replay, ExecutionGroup, 0, "Replay up to this many saved tests in each forked process, instead of forking per test (0 = off).");
 
 /* Fuzzing and symex related options, baked in to perform analysis-related tasks without auxiliary tools */
 DEFINE_bool(fuzz, AnalysisGroup, false, "Perform brute force unguided fuzzing.");
 DEFINE_bool(fuzz_save_passing, AnalysisGroup, false, "Save passing tests during fuzzing.");
 DEFINE_bool(fork, AnalysisGroup, true, "Fork when running a test.");
+DEFINE_bool(fork_server, AnalysisGroup, false, "Fork tests from a fork server process, rather than from the test harness.");
 DEFINE_int(seed, AnalysisGroup, 0, "Seed for brute force fuzzing (uses time if not set).");
 
 /* Test selection options to configure what test or tests should be executed during a run */
@@ -68,10 +92,102 @@ int DeepState_UsingLibFuzzer = 0;
 /* To make libFuzzer louder on mac OS. */
 int DeepState_LibFuzzerLoud = 0;
 
-/* Array of DeepState generated allocations.  Impossible for there to
- * be more than there are input bytes.  Index stores where we are. */
-char* DeepState_GeneratedAllocs[DeepState_InputSize];
-uint32_t DeepState_GeneratedAllocsIndex = 0;
+/* Memory that DeepState allocates on behalf of a test (generated strings,
+ * `DeepState_GCMalloc` data, swarm configurations' maps) is carved out of
+ * blocks of an arena, and all of it is released at once by
+ * `DeepState_CleanUp`. Allocations are aligned to `DEEPSTATE_ARENA_ALIGN`
+ * bytes. */
+#define DEEPSTATE_ARENA_ALIGN 16
+
+/* Size of the first block of the arena. Blocks double in size up to
+ * `DEEPSTATE_ARENA_MAX_BLOCK` bytes; bigger allocations get a block of
+ * their own, which isn't kept for the next test. */
+#define DEEPSTATE_ARENA_MIN_BLOCK 4096
+#define DEEPSTATE_ARENA_MAX_BLOCK (1 << 20)
+
+/* Bytes left unused, and poisoned, after each arena allocation, so that
+ * AddressSanitizer still catches overflows of generated data. */
+#ifdef DEEPSTATE_ARENA_ASAN
+#define DEEPSTATE_ARENA_REDZONE DEEPSTATE_ARENA_ALIGN
+#else
+#define DEEPSTATE_ARENA_REDZONE 0
+#endif
+
+struct DeepState_ArenaBlock {
+  struct DeepState_ArenaBlock *prev;
+  size_t size;
+  size_t used;
+  unsigned char data[];
+};
+
+static struct DeepState_ArenaBlock *DeepState_Arena = NULL;
+
+/* Allocate `num_bytes` bytes that last until `DeepState_CleanUp`. */
+static void *DeepState_ArenaAlloc(size_t num_bytes) {
+  struct DeepState_ArenaBlock *block = DeepState_Arena;
+  size_t need = num_bytes + DEEPSTATE_ARENA_REDZONE + DEEPSTATE_ARENA_ALIGN;
+  if (need < num_bytes) {
+    DeepState_Abandon("Can't allocate memory");
+  }
+
+  if (block == NULL || block->size - block->used < need) {
+    size_t size = DEEPSTATE_ARENA_MIN_BLOCK;
+    if (block != NULL && block->size <= DEEPSTATE_ARENA_MAX_BLOCK / 2) {
+      size = 2 * block->size;
+    } else if (block != NULL) {
+      size = DEEPSTATE_ARENA_MAX_BLOCK;
+    }
+    if (size < need) {
+      size = need;
+    }
+    if (size > SIZE_MAX - sizeof(struct DeepState_ArenaBlock)) {
+      DeepState_Abandon("Can't allocate memory");
+    }
+    block = (struct DeepState_ArenaBlock *) malloc(
+        sizeof(struct DeepState_ArenaBlock) + size);
+    if (block == NULL) {
+      DeepState_Abandon("Can't allocate memory");
+    }
+    ASAN_POISON_MEMORY_REGION(block->data, size);
+    block->prev = DeepState_Arena;
+    block->size = size;
+    block->used = 0;
+    DeepState_Arena = block;
+  }
+
+  uintptr_t addr = (uintptr_t) &(block->data[block->used]);
+  size_t pad = (size_t) (-addr & (DEEPSTATE_ARENA_ALIGN - 1));
+  void *data = &(block->data[block->used + pad]);
+  block->used += pad + num_bytes + DEEPSTATE_ARENA_REDZONE;
+  ASAN_UNPOISON_MEMORY_REGION(data, num_bytes);
+  return data;
+}
+
+/* Release everything allocated from the arena. Only one block, the biggest
+ * one that isn't oversized, is kept for the next test. */
+static void DeepState_ArenaReset(void) {
+  struct DeepState_ArenaBlock *keep = NULL;
+  struct DeepState_ArenaBlock *block = DeepState_Arena;
+  while (block != NULL) {
+    struct DeepState_ArenaBlock *prev = block->prev;
+    if (block->size <= DEEPSTATE_ARENA_MAX_BLOCK &&
+        (keep == NULL || block->size > keep->size)) {
+      if (keep != NULL) {
+        free(keep);
+      }
+      keep = block;
+    } else {
+      free(block);
+    }
+    block = prev;
+  }
+  if (keep != NULL) {
+    ASAN_POISON_MEMORY_REGION(keep->data, keep->used);
+    keep->prev = NULL;
+    keep->used = 0;
+  }
+  DeepState_Arena = keep;
+}
 
 /* Pointer to the last registers DeepState_TestInfo data structure */
 struct DeepState_TestInfo *DeepState_LastTestInfo = NULL;
@@ -82,13 +198,354 @@ struct DeepState_TestInfo *DeepState_FirstTestInfo = NULL;
 /* Pointer to the test being run in this process by Dr. Fuzz. */
 static struct DeepState_TestInfo *DeepState_DrFuzzTest = NULL;
 
-/* Initialize global input buffer and index. */
-volatile uint8_t DeepState_Input[DeepState_InputSize] = {};
+/* Initialize global input buffer and index. The buffer starts out in static
+ * storage, which the symbolic executors find through `DeepState_API`, and
+ * only moves to the heap if it has to grow.
+ *
+ * Symbolic executors need every read of the buffer to be a load, so it is
+ * `volatile`. Builds for concrete fuzzing define
+ * `DEEPSTATE_NONVOLATILE_INPUT`, which makes the buffer a plain array that
+ * the runtime reads through `DeepState_InputBytes`, so the compiler can
+ * combine and reorder the loads. `DeepState_Input` keeps its type either
+ * way. */
+#ifdef DEEPSTATE_NONVOLATILE_INPUT
+#define DEEPSTATE_INPUT_QUALIFIER
+#else
+#define DEEPSTATE_INPUT_QUALIFIER volatile
+#endif
+
+static DEEPSTATE_INPUT_QUALIFIER uint8_t DeepState_InputStorage[DEEPSTATE_SIZE] = {};
+volatile uint8_t *DeepState_Input = DeepState_InputStorage;
+#define DeepState_InputBytes \
+    ((DEEPSTATE_INPUT_QUALIFIER uint8_t *) DeepState_Input)
+uint32_t DeepState_InputSize = DEEPSTATE_SIZE;
+static uint32_t DeepState_InputCapacity = DEEPSTATE_SIZE;
 uint32_t DeepState_InputIndex = 0;
+uint32_t DeepState_InputGenerated = DEEPSTATE_SIZE;
+
+/* Number of bytes at the start of `DeepState_Input` that may be non-zero;
+ * the rest of the buffer is all zeros. */
+static uint32_t DeepState_InputDirtySize = DEEPSTATE_SIZE;
+
+/* State of the random number generator that lazily generates the input
+ * when fuzzing. Each fuzzed test starts from a state derived from the
+ * fuzzing seed and the number of tests fuzzed so far. */
+static uint64_t DeepState_InputGenState = 0;
+static uint64_t DeepState_FuzzSeed = 0;
+static uint64_t DeepState_FuzzNumTests = 0;
+
+/* The SplitMix64 generator: fast, seedable with any value, and needs only
+ * 64-bit arithmetic. */
+static uint64_t DeepState_SplitMix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+void DeepState_GenerateInput(uint32_t end) {
+  /* Generate a few words at a time, to go to the slow path less often. Only
+   * the end of the buffer can cut a word short, so the bytes generated only
+   * depend on the starting state. */
+  end = (end + 63u) & ~63u;
+  if (end > DeepState_InputSize) {
+    end = DeepState_InputSize;
+  }
+  DEEPSTATE_INPUT_QUALIFIER uint8_t *input = DeepState_InputBytes;
+  uint32_t i = DeepState_InputGenerated;
+  while (i < end) {
+    uint64_t bits = DeepState_SplitMix64(&DeepState_InputGenState);
+    for (int j = 0; j < 8 && i < end; j++, i++) {
+      input[i] = (uint8_t) bits;
+      bits >>= 8;
+    }
+  }
+  DeepState_InputGenerated = i;
+  if (i > DeepState_InputDirtySize) {
+    DeepState_InputDirtySize = i;
+  }
+}
+
+void DeepState_SetInputSize(uint32_t size) {
+  if (!size) {
+    size = DEEPSTATE_SIZE;
+  }
+
+  if (size > DeepState_InputCapacity) {
+    if (DeepState_UsingSymExec) {
+      DeepState_LogFormat(DeepState_LogWarning,
+                          "Can't grow the input buffer to %u bytes when "
+                          "running symbolically", size);
+      return;
+    }
+
+    /* The new part of the buffer is zeroed, so the current input carries
+     * over unchanged. */
+    volatile uint8_t *input = (volatile uint8_t *) calloc(size, 1);
+    if (input == NULL) {
+      DeepState_Abandon("Error allocating memory");
+    }
+    memcpy((void *) input, (void *) DeepState_Input, DeepState_InputDirtySize);
+
+    if (DeepState_Input != DeepState_InputStorage) {
+      free((void *) DeepState_Input);
+    }
+    DeepState_Input = input;
+    DeepState_InputCapacity = size;
+  }
+
+  if (DeepState_InputGenerated >= DeepState_InputSize) {
+    DeepState_InputGenerated = size;
+  }
+  DeepState_InputSize = size;
+}
+
+void DeepState_ClearInputFrom(uint32_t size) {
+  if (DeepState_InputDirtySize > size) {
+    memset((void *) &(DeepState_Input[size]), 0,
+           DeepState_InputDirtySize - size);
+  }
+  DeepState_InputDirtySize = size;
+}
+
+/* What reads past the end of the input get, from `--input_exhaustion`. */
+enum DeepState_InputExhaustion {
+  DeepState_InputExhaustionAbandon,
+  DeepState_InputExhaustionZero,
+  DeepState_InputExhaustionExtend,
+  DeepState_InputExhaustionUnknown
+};
+
+static enum DeepState_InputExhaustion DeepState_InputExhaustionPolicy =
+    DeepState_InputExhaustionUnknown;
+
+/* Generated bytes not yet read past the end of the input buffer, so that
+ * reading them one at a time gives the same bytes as reading them in bulk. */
+static uint64_t DeepState_ExhaustedBits = 0;
+static unsigned DeepState_NumExhaustedBytes = 0;
+
+static enum DeepState_InputExhaustion DeepState_GetInputExhaustion(void) {
+  if (DEEPSTATE_UNLIKELY(DeepState_InputExhaustionPolicy ==
+                         DeepState_InputExhaustionUnknown)) {
+    DeepState_InputExhaustionPolicy = DeepState_InputExhaustionAbandon;
+    if (DeepState_UsingSymExec || !HAS_FLAG_input_exhaustion ||
+        !strcmp(FLAGS_input_exhaustion, "abandon")) {
+      /* Keep the default. */
+    } else if (!strcmp(FLAGS_input_exhaustion, "zero")) {
+      DeepState_InputExhaustionPolicy = DeepState_InputExhaustionZero;
+    } else if (!strcmp(FLAGS_input_exhaustion, "extend")) {
+      DeepState_InputExhaustionPolicy = DeepState_InputExhaustionExtend;
+    } else {
+      DeepState_LogFormat(DeepState_LogWarning,
+                          "Unknown --input_exhaustion policy `%s`; "
+                          "abandoning tests that run out of input",
+                          FLAGS_input_exhaustion);
+    }
+  }
+  return DeepState_InputExhaustionPolicy;
+}
 
-/* Swarm related state. */
+void DeepState_SetInputEnd(uint32_t size) {
+  if (DeepState_GetInputExhaustion() != DeepState_InputExhaustionExtend) {
+    return;
+  }
+
+  /* Seed the generator with an FNV-1a hash of the input, so that the same
+   * input is always extended the same way. */
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (uint32_t i = 0; i < size; ++i) {
+    hash = (hash ^ DeepState_InputBytes[i]) * 0x100000001b3ULL;
+  }
+  DeepState_InputGenState = hash;
+  if (size < DeepState_InputGenerated) {
+    DeepState_InputGenerated = size;
+  }
+}
+
+/* Fill `bytes` with `num_bytes` bytes from past the end of the input buffer,
+ * according to `--input_exhaustion`. */
+static void DeepState_FillExhaustedInput(uint8_t *bytes, size_t num_bytes) {
+  switch (DeepState_GetInputExhaustion()) {
+    case DeepState_InputExhaustionZero:
+      memset(bytes, 0, num_bytes);
+      break;
+    case DeepState_InputExhaustionExtend:
+      for (size_t i = 0; i < num_bytes; ++i) {
+        if (!DeepState_NumExhaustedBytes) {
+          DeepState_ExhaustedBits =
+              DeepState_SplitMix64(&DeepState_InputGenState);
+          DeepState_NumExhaustedBytes = 8;
+        }
+        bytes[i] = (uint8_t) DeepState_ExhaustedBits;
+        DeepState_ExhaustedBits >>= 8;
+        DeepState_NumExhaustedBytes--;
+      }
+      break;
+    default:
+      DeepState_Abandon("Exceeded set input limit. Set --max_input_size or expand DEEPSTATE_SIZE to read more bytes.");
+  }
+}
+
+/* The next byte of input, when the input buffer has run out. */
+static uint8_t DeepState_ExhaustedInputByte(void) {
+  uint8_t byte;
+  DeepState_FillExhaustedInput(&byte, 1);
+  return byte;
+}
+
+/* Make sure the next `num_bytes` bytes of input are available to read. */
+static DEEPSTATE_INLINE void DeepState_NeedInput(size_t num_bytes) {
+  if (DEEPSTATE_UNLIKELY(num_bytes >
+                         DeepState_InputGenerated - DeepState_InputIndex)) {
+    DeepState_GenerateInput(num_bytes < DeepState_InputSize ?
+                            DeepState_InputIndex + (uint32_t) num_bytes :
+                            DeepState_InputSize);
+  }
+}
+
+/* The `--trace_reads` trace, mapped from its file. */
+struct DeepState_TraceHeader *DeepState_ReadTrace = NULL;
+static struct DeepState_TraceEntry *DeepState_ReadTraceEntries = NULL;
+
+void DeepState_AddTraceEntry(enum DeepState_TraceEvent event,
+                             enum DeepState_TraceReadType type,
+                             uint32_t offset, uint32_t size, int64_t value) {
+  uint64_t count = DeepState_ReadTrace->count;
+  struct DeepState_TraceEntry *entry =
+      &(DeepState_ReadTraceEntries[count % DEEPSTATE_TRACE_SIZE]);
+  entry->event = (uint16_t) event;
+  entry->type = (uint16_t) type;
+  entry->offset = offset;
+  entry->size = size;
+  entry->reserved = 0;
+  entry->value = value;
+  DeepState_ReadTrace->count = count + 1;
+}
+
+/* Create the `--trace_reads` file and map it into memory. If that fails,
+ * reads aren't traced. */
+static void DeepState_OpenReadTrace(void) {
+  size_t trace_size = sizeof(struct DeepState_TraceHeader) +
+                      DEEPSTATE_TRACE_SIZE * sizeof(struct DeepState_TraceEntry);
+  void *mem = MAP_FAILED;
+  int fd = open(FLAGS_trace_reads, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0) {
+    if (!ftruncate(fd, (off_t) trace_size)) {
+      mem = mmap(NULL, trace_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+  }
+  if (mem == MAP_FAILED) {
+    DeepState_LogFormat(DeepState_LogWarning,
+                        "Unable to create trace file %s; not tracing reads",
+                        FLAGS_trace_reads);
+    HAS_FLAG_trace_reads = 0;
+    return;
+  }
+  DeepState_ReadTrace = (struct DeepState_TraceHeader *) mem;
+  DeepState_ReadTraceEntries = (struct DeepState_TraceEntry *)
+      (DeepState_ReadTrace + 1);
+  DeepState_ReadTrace->magic = DEEPSTATE_TRACE_MAGIC;
+  DeepState_ReadTrace->capacity = DEEPSTATE_TRACE_SIZE;
+  DeepState_ReadTrace->count = 0;
+}
+
+/* Can input be read in bulk? Symbolic executors need each byte of input to
+ * be read on its own, and `--verbose_reads` logs every byte read. */
+static DEEPSTATE_INLINE int DeepState_CanReadInBulk(void) {
+  return DEEPSTATE_LIKELY(!DeepState_UsingSymExec && !FLAGS_verbose_reads);
+}
+
+/* Copy the next `num_bytes` bytes of input into `bytes`, with one bounds
+ * check for all of them. */
+static DEEPSTATE_INLINE void DeepState_ReadInput(void *bytes,
+                                                 size_t num_bytes) {
+  if (DEEPSTATE_UNLIKELY(num_bytes >
+                         DeepState_InputSize - DeepState_InputIndex)) {
+    size_t num_left = DeepState_InputSize - DeepState_InputIndex;
+    DeepState_NeedInput(num_left);
+    memcpy(bytes, (const void *) &(DeepState_Input[DeepState_InputIndex]),
+           num_left);
+    DeepState_InputIndex = DeepState_InputSize;
+    DeepState_FillExhaustedInput((uint8_t *) bytes + num_left,
+                                 num_bytes - num_left);
+    return;
+  }
+  DeepState_NeedInput(num_bytes);
+  memcpy(bytes, (const void *) &(DeepState_Input[DeepState_InputIndex]),
+         num_bytes);
+  DeepState_InputIndex += (uint32_t) num_bytes;
+}
+
+/* Read the next `num_bytes` bytes of input in bulk, as a big-endian integer,
+ * which is how the byte-at-a-time readers assemble them. */
+static DEEPSTATE_INLINE uint64_t DeepState_ReadBigEndian(size_t num_bytes) {
+  switch (num_bytes) {
+    case 1: {
+      uint8_t val;
+      DeepState_ReadInput(&val, 1);
+      return val;
+    }
+    case 2: {
+      uint16_t val;
+      DeepState_ReadInput(&val, 2);
+      return DEEPSTATE_LITTLE_ENDIAN ? DEEPSTATE_BSWAP16(val) : val;
+    }
+    case 4: {
+      uint32_t val;
+      DeepState_ReadInput(&val, 4);
+      return DEEPSTATE_LITTLE_ENDIAN ? DEEPSTATE_BSWAP32(val) : val;
+    }
+    default: {
+      uint64_t val;
+      DeepState_ReadInput(&val, 8);
+      return DEEPSTATE_LITTLE_ENDIAN ? DEEPSTATE_BSWAP64(val) : val;
+    }
+  }
+}
+
+/* Map a value of `num_bytes` random bytes onto `[0, span]`. The value is
+ * scaled with a multiply and a shift, rather than a modulus: each value in
+ * the range comes from as equal a number of byte patterns as possible, and
+ * bigger bytes map to bigger values. */
+static uint64_t DeepState_ScaleToSpan(uint64_t x, unsigned num_bytes,
+                                      uint64_t span) {
+  if (span == UINT64_MAX) {
+    return x;
+  } else if (num_bytes <= 4) {
+    return (x * (span + 1)) >> (8 * num_bytes);
+  }
+#if defined(__SIZEOF_INT128__)
+  return (uint64_t) (((unsigned __int128) x * (span + 1)) >> (8 * num_bytes));
+#else
+  return x % (span + 1);
+#endif
+}
+
+/* Swarm related state. The configurations of the current test are the first
+ * `DeepState_SwarmConfigsIndex` of `DeepState_SwarmConfigs`. */
 uint32_t DeepState_SwarmConfigsIndex = 0;
 struct DeepState_SwarmConfig *DeepState_SwarmConfigs[DEEPSTATE_MAX_SWARM_CONFIGS];
+static struct DeepState_SwarmConfig
+    DeepState_SwarmConfigStorage[DEEPSTATE_MAX_SWARM_CONFIGS];
+
+/* Number of slots in the table that finds swarm configurations by call site.
+ * It is a power of two, and at least twice the number of configurations. */
+#define DEEPSTATE_SWARM_TABLE_SIZE 2048
+
+/* A call site in the table of swarm configurations: which of the current
+ * test's configurations it uses, if it was looked up in this test. Entries
+ * outlive tests, and are checked against the configuration they point to. */
+struct DeepState_SwarmTableEntry {
+  const char *file;
+  unsigned line;
+  unsigned fcount;
+  uint32_t index;
+};
+
+static struct DeepState_SwarmTableEntry
+    DeepState_SwarmTable[DEEPSTATE_SWARM_TABLE_SIZE];
+static unsigned DeepState_SwarmTableUsed = 0;
 
 /* Jump buffer for returning to `DeepState_Run`. */
 jmp_buf DeepState_ReturnToRun = {};
@@ -143,12 +600,14 @@ void DeepState_Abandon(const char *reason) {
 /* Mark this test as having crashed. */
 void DeepState_Crash(void) {
   DeepState_SetTestFailed();
+  DeepState_FlushLog();
 }
 
 /* Mark this test as failing. */
 DEEPSTATE_NORETURN
 void DeepState_Fail(void) {
   DeepState_SetTestFailed();
+  DeepState_FlushLog();
 
   if (FLAGS_take_over) {
     // We want to communicate the failure to a parent process, so exit.
@@ -166,6 +625,7 @@ void DeepState_Pass(void) {
 
 void DeepState_SoftFail(void) {
   DeepState_SetTestFailed();
+  DeepState_FlushLog();
 }
 
 /* Symbolize the data in the exclusive range `[begin, end)`. */
@@ -179,14 +639,22 @@ void DeepState_SymbolizeData(void *begin, void *end) {
     return;
   } else {
     uint8_t *bytes = (uint8_t *) begin;
+    DeepState_TraceInput(DeepState_TraceRead, DeepState_TraceBytes,
+                         end_addr - begin_addr, 0);
+    if (DeepState_CanReadInBulk()) {
+      DeepState_ReadInput(bytes, end_addr - begin_addr);
+      return;
+    }
+    DeepState_NeedInput(end_addr - begin_addr);
     for (uintptr_t i = 0, max_i = (end_addr - begin_addr); i < max_i; ++i) {
       if (DeepState_InputIndex >= DeepState_InputSize) {
-        DeepState_Abandon("Exceeded set input limit. Set or expand DEEPSTATE_SIZE to write more bytes.");
+        bytes[i] = DeepState_ExhaustedInputByte();
+        continue;
       }
       if (FLAGS_verbose_reads) {
         printf("Reading byte at %u\n", DeepState_InputIndex);
       }
-      bytes[i] = DeepState_Input[DeepState_InputIndex++];
+      bytes[i] = DeepState_InputBytes[DeepState_InputIndex++];
     }
   }
 }
@@ -203,14 +671,26 @@ void DeepState_SymbolizeDataNoNull(void *begin, void *end) {
     return;
   } else {
     uint8_t *bytes = (uint8_t *) begin;
+    DeepState_TraceInput(DeepState_TraceRead, DeepState_TraceNoNullBytes,
+                         end_addr - begin_addr, 0);
+    if (DeepState_CanReadInBulk()) {
+      uintptr_t num_bytes = end_addr - begin_addr;
+      DeepState_ReadInput(bytes, num_bytes);
+      for (uintptr_t i = 0; i < num_bytes; ++i) {
+        bytes[i] += !bytes[i];  /* Replace nulls with ones. */
+      }
+      return;
+    }
+    DeepState_NeedInput(end_addr - begin_addr);
     for (uintptr_t i = 0, max_i = (end_addr - begin_addr); i < max_i; ++i) {
       if (DeepState_InputIndex >= DeepState_InputSize) {
-        DeepState_Abandon("Exceeded set input limit. Set or expand DEEPSTATE_SIZE to write more bytes.");
-      }
-      if (FLAGS_verbose_reads) {
-        printf("Reading byte at %u\n", DeepState_InputIndex);
+        bytes[i] = DeepState_ExhaustedInputByte();
+      } else {
+        if (FLAGS_verbose_reads) {
+          printf("Reading byte at %u\n", DeepState_InputIndex);
+        }
+        bytes[i] = DeepState_InputBytes[DeepState_InputIndex++];
       }
-      bytes[i] = DeepState_Input[DeepState_InputIndex++];
       if (bytes[i] == 0) {
         bytes[i] = 1;
       }
@@ -223,6 +703,62 @@ void *DeepState_ConcretizeData(void *begin, void *end) {
   return begin;
 }
 
+/* Draw `len` characters into `str`, each one an index into the `num_chars`
+ * characters of `allowed` (or, if `allowed` is null, the characters 1 to
+ * 255), by way of `fmap` if it is not null.
+ *
+ * Indices are drawn as `DeepState_UIntInRange(0, num_chars - 1)` would draw
+ * them, but when input can be read in bulk, all of them are read at once and
+ * mapped in one pass, and traced as reads of bytes. Under
+ * `DEEPSTATE_COMPACT_RANGES`, that is one byte per character for up to 256
+ * characters. */
+static void DeepState_FillCStr(char *str, size_t len, const char *allowed,
+                               uint32_t num_chars, const unsigned *fmap) {
+  if (num_chars == 0) {
+    DeepState_Abandon("Can't draw characters from an empty set.");
+  }
+  if (num_chars == 1 || !DeepState_CanReadInBulk()) {
+    for (size_t i = 0; i < len; i++) {
+      uint32_t j = DeepState_UIntInRange(0U, num_chars - 1);
+      j = fmap ? fmap[j] : j;
+      str[i] = allowed ? allowed[j] : (char) (j + 1);
+    }
+    return;
+  }
+
+#ifdef DEEPSTATE_COMPACT_RANGES
+  unsigned num_bytes = 1;
+  while (num_bytes < 4 && ((num_chars - 1) >> (8 * num_bytes))) {
+    num_bytes++;
+  }
+#else
+  const unsigned num_bytes = sizeof(uint32_t);
+#endif
+
+  uint8_t bytes[1024];
+  const size_t chunk = sizeof(bytes) / num_bytes;
+  for (size_t done = 0; done < len; done += chunk) {
+    size_t n = (len - done < chunk) ? (len - done) : chunk;
+    DeepState_TraceInput(DeepState_TraceRead, DeepState_TraceBytes,
+                         n * num_bytes, 0);
+    DeepState_ReadInput(bytes, n * num_bytes);
+    for (size_t i = 0; i < n; i++) {
+      uint64_t x = 0;
+      for (unsigned b = 0; b < num_bytes; b++) {
+        x = (x << 8) | bytes[i * num_bytes + b];
+      }
+#ifdef DEEPSTATE_COMPACT_RANGES
+      uint32_t j = (uint32_t) DeepState_ScaleToSpan(x, num_bytes,
+                                                    num_chars - 1);
+#else
+      uint32_t j = (uint32_t) (x % num_chars);
+#endif
+      j = fmap ? fmap[j] : j;
+      str[done + i] = allowed ? allowed[j] : (char) (j + 1);
+    }
+  }
+}
+
 /* Assign a symbolic C string of strlen length `len`.  str should include
  * storage for both `len` characters AND the null terminator.  Allowed
  * is a set of chars that are allowed (ignored if null). */
@@ -237,10 +773,7 @@ void DeepState_AssignCStr_C(char* str, size_t len, const char* allowed) {
     if (allowed == 0) {
       DeepState_SymbolizeDataNoNull(str, &(str[len]));
     } else {
-      uint32_t allowed_size = strlen(allowed);
-      for (int i = 0; i < len; i++) {
-        str[i] = allowed[DeepState_UIntInRange(0, allowed_size-1)];
-      }
+      DeepState_FillCStr(str, len, allowed, strlen(allowed), NULL);
     }
   }
   str[len] = '\0';
@@ -254,21 +787,11 @@ void DeepState_SwarmAssignCStr_C(const char* file, unsigned line, int stype,
   if (NULL == str) {
     DeepState_Abandon("Attempted to populate null pointer.");
   }
-  char swarm_allowed[256];  
-  if (allowed == 0) {
-    /* In swarm mode, if there is no allowed string, create one over all chars. */
-    for (int i = 0; i < 255; i++) {
-      swarm_allowed[i] = i+1;
-    }
-    swarm_allowed[255] = 0;
-    allowed = (const char*)&swarm_allowed;
-  }
   if (len) {
-    uint32_t allowed_size = strlen(allowed);
+    /* In swarm mode, if there is no allowed string, draw from all chars. */
+    uint32_t allowed_size = allowed ? strlen(allowed) : 255;
     struct DeepState_SwarmConfig* sc = DeepState_GetSwarmConfig(allowed_size, file, line, stype);
-    for (int i = 0; i < len; i++) {
-      str[i] = allowed[sc->fmap[DeepState_UIntInRange(0U, sc->fcount-1)]];
-    }
+    DeepState_FillCStr(str, len, allowed, sc->fcount, sc->fmap);
   }
   str[len] = '\0';
 }
@@ -278,19 +801,12 @@ char *DeepState_CStr_C(size_t len, const char* allowed) {
   if (SIZE_MAX <= len) {
     DeepState_Abandon("Can't create a SIZE_MAX-length string");
   }
-  char *str = (char *) malloc(sizeof(char) * (len + 1));
-  if (NULL == str) {
-    DeepState_Abandon("Can't allocate memory");
-  }
-  DeepState_GeneratedAllocs[DeepState_GeneratedAllocsIndex++] = str;
+  char *str = (char *) DeepState_ArenaAlloc(sizeof(char) * (len + 1));
   if (len) {
     if (allowed == 0) {
       DeepState_SymbolizeDataNoNull(str, &(str[len]));
     } else {
-      uint32_t allowed_size = strlen(allowed);
-      for (int i = 0; i < len; i++) {
-        str[i] = allowed[DeepState_UIntInRange(0, allowed_size-1)];
-      }
+      DeepState_FillCStr(str, len, allowed, strlen(allowed), NULL);
     }
   }
   str[len] = '\0';
@@ -302,26 +818,12 @@ char *DeepState_SwarmCStr_C(const char* file, unsigned line, int stype,
   if (SIZE_MAX <= len) {
     DeepState_Abandon("Can't create a SIZE_MAX-length string");
   }
-  char *str = (char *) malloc(sizeof(char) * (len + 1));
-  if (NULL == str) {
-    DeepState_Abandon("Can't allocate memory");
-  }
-  char swarm_allowed[256];  
-  if (allowed == 0) {
-    /* In swarm mode, if there is no allowed string, create one over all chars. */
-    for (int i = 0; i < 255; i++) {
-      swarm_allowed[i] = i+1;
-    }
-    swarm_allowed[255] = 0;
-    allowed = (const char*)&swarm_allowed;
-  }
-  DeepState_GeneratedAllocs[DeepState_GeneratedAllocsIndex++] = str;
+  char *str = (char *) DeepState_ArenaAlloc(sizeof(char) * (len + 1));
   if (len) {
-    uint32_t allowed_size = strlen(allowed);
+    /* In swarm mode, if there is no allowed string, draw from all chars. */
+    uint32_t allowed_size = allowed ? strlen(allowed) : 255;
     struct DeepState_SwarmConfig* sc = DeepState_GetSwarmConfig(allowed_size, file, line, stype);
-    for (int i = 0; i < len; i++) {
-      str[i] = allowed[sc->fmap[DeepState_UIntInRange(0U, sc->fcount-1)]];
-    }
+    DeepState_FillCStr(str, len, allowed, sc->fcount, sc->fmap);
   }
   str[len] = '\0';
   return str;
@@ -333,13 +835,7 @@ void DeepState_SymbolizeCStr_C(char *begin, const char* allowed) {
     if (allowed == 0) {
       DeepState_SymbolizeDataNoNull(begin, begin + strlen(begin));
     } else {
-      uint32_t allowed_size = strlen(allowed);
-      uint8_t *bytes = (uint8_t *) begin;
-      uintptr_t begin_addr = (uintptr_t) begin;
-      uintptr_t end_addr = (uintptr_t) (begin + strlen(begin));
-      for (uintptr_t i = 0, max_i = (end_addr - begin_addr); i < max_i; ++i) {
-        bytes[i] = allowed[DeepState_UIntInRange(0, allowed_size-1)];
-      }
+      DeepState_FillCStr(begin, strlen(begin), allowed, strlen(allowed), NULL);
     }
   }
 }
@@ -347,23 +843,10 @@ void DeepState_SymbolizeCStr_C(char *begin, const char* allowed) {
 void DeepState_SwarmSymbolizeCStr_C(const char* file, unsigned line, int stype,
 				    char *begin, const char* allowed) {
   if (begin && begin[0]) {
-    char swarm_allowed[256];    
-    if (allowed == 0) {
-      /* In swarm mode, if there is no allowed string, create one over all chars. */
-      for (int i = 0; i < 255; i++) {
-	swarm_allowed[i] = i+1;
-      }
-      swarm_allowed[255] = 0;
-      allowed = (const char*)&swarm_allowed;      
-    }
-    uint32_t allowed_size = strlen(allowed);
+    /* In swarm mode, if there is no allowed string, draw from all chars. */
+    uint32_t allowed_size = allowed ? strlen(allowed) : 255;
     struct DeepState_SwarmConfig* sc = DeepState_GetSwarmConfig(allowed_size, file, line, stype);
-    uint8_t *bytes = (uint8_t *) begin;
-    uintptr_t begin_addr = (uintptr_t) begin;
-    uintptr_t end_addr = (uintptr_t) (begin + strlen(begin));
-    for (uintptr_t i = 0, max_i = (end_addr - begin_addr); i < max_i; ++i) {
-      bytes[i] = allowed[sc->fmap[DeepState_UIntInRange(0U, sc->fcount-1)]];
-    }
+    DeepState_FillCStr(begin, strlen(begin), allowed, sc->fcount, sc->fmap);
   }
 }
 
@@ -382,10 +865,9 @@ void *DeepState_Malloc(size_t num_bytes) {
 
 /* Allocate and return a pointer to `num_bytes` symbolic bytes. */
 void *DeepState_GCMalloc(size_t num_bytes) {
-  void *data = malloc(num_bytes);
+  void *data = DeepState_ArenaAlloc(num_bytes);
   uintptr_t data_end = ((uintptr_t) data) + num_bytes;
   DeepState_SymbolizeData(data, (void *) data_end);
-  DeepState_GeneratedAllocs[DeepState_GeneratedAllocsIndex++] = data;
   return data;
 }
 
@@ -401,14 +883,18 @@ void *DeepState_MemScrub(void *pointer, size_t data_size) {
 /* Generate a new swarm configuration. */
 struct DeepState_SwarmConfig *DeepState_NewSwarmConfig(unsigned fcount, const char* file, unsigned line,
 						       enum DeepState_SwarmType stype) {
-  struct DeepState_SwarmConfig *new_config = malloc(sizeof(struct DeepState_SwarmConfig));
-  new_config->file = malloc(strlen(file) + 1);
-  strncpy(new_config->file, file, strlen(file));
+  if (DeepState_SwarmConfigsIndex == DEEPSTATE_MAX_SWARM_CONFIGS) {
+    DeepState_Abandon("Exceeded swarm config limit. Set or expand DEEPSTATE_MAX_SWARM_CONFIGS. This is highly unusual.");
+  }
+  struct DeepState_SwarmConfig *new_config =
+      &(DeepState_SwarmConfigStorage[DeepState_SwarmConfigsIndex]);
+  new_config->file = file;
   new_config->line = line;
   new_config->orig_fcount = fcount;
   new_config->fcount = 0;
   if (stype == DeepState_SwarmTypeProb) {
-    new_config->fmap = malloc(sizeof(unsigned) * fcount * DEEPSTATE_SWARM_MAX_PROB_RATIO);
+    new_config->fmap = (unsigned *) DeepState_ArenaAlloc(
+        fcount * DEEPSTATE_SWARM_MAX_PROB_RATIO * sizeof(unsigned));
     for (int i = 0; i < fcount; i++) {
       unsigned int prob = DeepState_UIntInRange(0U, DEEPSTATE_SWARM_MAX_PROB_RATIO);
       for (int j = 0; j < prob; j++) {
@@ -419,7 +905,7 @@ struct DeepState_SwarmConfig *DeepState_NewSwarmConfig(unsigned fcount, const ch
       new_config->fmap[new_config->fcount++] = DeepState_UIntInRange(0, fcount-1);
     }
   } else {
-    new_config->fmap = malloc(sizeof(unsigned) * fcount);
+    new_config->fmap = (unsigned *) DeepState_ArenaAlloc(fcount * sizeof(unsigned));
     /* In mix mode, "half" the time just use everything */
     int full_config = (stype == DeepState_SwarmTypeMixed) && DeepState_Bool();
     if ((stype == DeepState_SwarmTypeMixed) && DeepState_UsingSymExec) {
@@ -445,24 +931,74 @@ struct DeepState_SwarmConfig *DeepState_NewSwarmConfig(unsigned fcount, const ch
   if (new_config->fcount == 0) {
     new_config->fmap[new_config->fcount++] = DeepState_UIntInRange(0, fcount-1);
   }
+  DeepState_SwarmConfigs[DeepState_SwarmConfigsIndex++] = new_config;
   return new_config;
 }
 
+/* Is `sc` the configuration of the call site? Call sites are told apart by
+ * file name, rather than by the `file` pointer, since a header compiled into
+ * several files has one call site in each. */
+static int DeepState_IsSwarmConfigOf(struct DeepState_SwarmConfig *sc,
+                                     unsigned fcount, const char *file,
+                                     unsigned line) {
+  return sc->line == line && sc->orig_fcount == fcount &&
+         (sc->file == file || !strcmp(sc->file, file));
+}
+
 /* Either fetch existing configuration, or generate a new one. */
 struct DeepState_SwarmConfig *DeepState_GetSwarmConfig(unsigned fcount, const char* file, unsigned line,
 						       enum DeepState_SwarmType stype) {
-  /* In general, there should be few enough OneOfs in a harness that linear search is fine. */
-  for (int i = 0; i < DeepState_SwarmConfigsIndex; i++) {
-    struct DeepState_SwarmConfig* sc = DeepState_SwarmConfigs[i];
-    if ((sc->line == line) && (sc->orig_fcount == fcount) && (strncmp(sc->file, file, strlen(file)) == 0)) {
-      return sc;
+  uint64_t hash = ((uint64_t) (uintptr_t) file * 0x9e3779b97f4a7c15ULL) ^
+                  ((uint64_t) line << 32) ^ fcount;
+  unsigned slot = (unsigned) ((hash * 0xbf58476d1ce4e5b9ULL) >> 40) &
+                  (DEEPSTATE_SWARM_TABLE_SIZE - 1);
+  struct DeepState_SwarmTableEntry *entry;
+  for (;; slot = (slot + 1) & (DEEPSTATE_SWARM_TABLE_SIZE - 1)) {
+    entry = &(DeepState_SwarmTable[slot]);
+    if (entry->file == NULL) {
+      break;
+    }
+    if (entry->file == file && entry->line == line && entry->fcount == fcount) {
+      if (entry->index < DeepState_SwarmConfigsIndex) {
+        struct DeepState_SwarmConfig *sc = DeepState_SwarmConfigs[entry->index];
+        if (DeepState_IsSwarmConfigOf(sc, fcount, file, line)) {
+          return sc;
+        }
+      }
+      break;  /* Not looked up yet in this test. */
     }
   }
-  if (DeepState_SwarmConfigsIndex == DEEPSTATE_MAX_SWARM_CONFIGS) {
-    DeepState_Abandon("Exceeded swarm config limit. Set or expand DEEPSTATE_MAX_SWARM_CONFIGS. This is highly unusual.");
+
+  /* The first lookup from this call site in this test. The configuration
+   * may still exist, if made from another file's copy of the call site. */
+  struct DeepState_SwarmConfig *sc = NULL;
+  uint32_t index;
+  for (index = 0; index < DeepState_SwarmConfigsIndex; index++) {
+    if (DeepState_IsSwarmConfigOf(DeepState_SwarmConfigs[index], fcount, file,
+                                  line)) {
+      sc = DeepState_SwarmConfigs[index];
+      break;
+    }
+  }
+  if (sc == NULL) {
+    sc = DeepState_NewSwarmConfig(fcount, file, line, stype);
+    index = DeepState_SwarmConfigsIndex - 1;
   }
-  DeepState_SwarmConfigs[DeepState_SwarmConfigsIndex] = DeepState_NewSwarmConfig(fcount, file, line, stype);
-  return DeepState_SwarmConfigs[DeepState_SwarmConfigsIndex++];
+
+  if (entry->file == NULL) {
+    if (DeepState_SwarmTableUsed >= DEEPSTATE_SWARM_TABLE_SIZE / 2) {
+      /* Too full to probe quickly; start over. */
+      memset(DeepState_SwarmTable, 0, sizeof(DeepState_SwarmTable));
+      DeepState_SwarmTableUsed = 0;
+      return DeepState_GetSwarmConfig(fcount, file, line, stype);
+    }
+    DeepState_SwarmTableUsed++;
+    entry->file = file;
+    entry->line = line;
+    entry->fcount = fcount;
+  }
+  entry->index = index;
+  return sc;
 }
 
 DEEPSTATE_NOINLINE int DeepState_One(void) {
@@ -493,12 +1029,14 @@ int DeepState_IsTrue(int expr) {
 /* Return a symbolic value of a given type. */
 int DeepState_Bool(void) {
   if (DeepState_InputIndex >= DeepState_InputSize) {
-    DeepState_Abandon("Exceeded set input limit. Set or expand DEEPSTATE_SIZE to write more bytes.");
+    return DeepState_ExhaustedInputByte() & 1;
   }
   if (FLAGS_verbose_reads) {
     printf("Reading byte as boolean at %u\n", DeepState_InputIndex);
   }
-  return DeepState_Input[DeepState_InputIndex++] & 1;
+  DeepState_TraceInput(DeepState_TraceRead, DeepState_TraceBool, 1, 0);
+  DeepState_NeedInput(1);
+  return DeepState_InputBytes[DeepState_InputIndex++] & 1;
 }
 
 /* Return a string path to an input file or directory without parsing it to a type. This is
@@ -542,9 +1080,12 @@ const char * DeepState_InputPath(char *testcase_path) {
 
 #define MAKE_SYMBOL_FUNC(Type, type) \
     type DeepState_ ## Type(void) { \
-      if ((DeepState_InputIndex + sizeof(type)) > DeepState_InputSize) { \
-        DeepState_Abandon("Exceeded set input limit. Set or expand DEEPSTATE_SIZE to write more bytes."); \
+      DeepState_TraceInput(DeepState_TraceRead, DeepState_TraceInt, \
+                           sizeof(type), 0); \
+      if (DeepState_CanReadInBulk()) { \
+        return (type) DeepState_ReadBigEndian(sizeof(type)); \
       } \
+      DeepState_NeedInput(sizeof(type)); \
       type val = 0; \
       if (FLAGS_verbose_reads) { \
         printf("STARTING MULTI-BYTE READ\n"); \
@@ -554,7 +1095,11 @@ const char * DeepState_InputPath(char *testcase_path) {
         if (FLAGS_verbose_reads) { \
           printf("Reading byte at %u\n", DeepState_InputIndex); \
         } \
-        val = (val << 8) | ((type) DeepState_Input[DeepState_InputIndex++]); \
+        if (DeepState_InputIndex >= DeepState_InputSize) { \
+          val = (val << 8) | ((type) DeepState_ExhaustedInputByte()); \
+          continue; \
+        } \
+        val = (val << 8) | ((type) DeepState_InputBytes[DeepState_InputIndex++]); \
       } \
       if (FLAGS_verbose_reads) { \
         printf("FINISHED MULTI-BYTE READ\n"); \
@@ -601,52 +1146,396 @@ int8_t DeepState_Char(void) {
 
 #undef MAKE_SYMBOL_FUNC
 
-float DeepState_FloatInRange(float low, float high) {
-  if (low > high) {
-    return DeepState_FloatInRange(high, low);
-  }
-  if (low < 0.0) { // Handle negatives differently
-    if (high > 0.0) {
-      if (DeepState_Bool()) {
-	return -(DeepState_FloatInRange(0.0, -low));
-      } else {
-	return DeepState_FloatInRange(0.0, high);
-      }
-    } else {
-      return -(DeepState_FloatInRange(-high, -low));
+/* Floating-point values are drawn by way of their keys: unsigned integers
+ * in the same order as the values they stand for, from -infinity up to
+ * +infinity, with -0 just below +0. NaNs have keys outside of that.
+ *
+ * `DeepState_FloatEdges` picks one of these values half of the time, and
+ * otherwise draws like `DeepState_FloatBits`. The ones outside of the range
+ * are clamped to it. */
+#define MAKE_FLOAT_RANGE_FUNC(Type, type, UType, utype, sign_bit, max, min) \
+    static utype DeepState_ ## Type ## Key(type f) { \
+      utype bits; \
+      memcpy(&bits, &f, sizeof(bits)); \
+      return (bits & sign_bit) ? ~bits : (bits | sign_bit); \
+    } \
+    \
+    static type DeepState_ ## Type ## FromKey(utype key) { \
+      utype bits = (key & sign_bit) ? (key & ~sign_bit) : ~key; \
+      type f; \
+      memcpy(&f, &bits, sizeof(f)); \
+      return f; \
+    } \
+    \
+    type DeepState_ ## Type ## InRangeUsing( \
+        type low, type high, enum DeepState_FloatDistribution distribution) { \
+      if (low != low || high != high) { \
+        DeepState_Abandon("NaN bound of " #type " range"); \
+      } \
+      if (low > high) { \
+        type tmp = low; \
+        low = high; \
+        high = tmp; \
+      } \
+      if (DeepState_UsingSymExec) { \
+        type v = DeepState_ ## Type(); \
+        (void) DeepState_Assume(low <= v && v <= high); \
+        return v; \
+      } \
+      \
+      utype key_low = DeepState_ ## Type ## Key(low); \
+      utype key_high = DeepState_ ## Type ## Key(high); \
+      if (key_low > key_high) {  /* `+0` to `-0`. */ \
+        utype tmp = key_low; \
+        key_low = key_high; \
+        key_high = tmp; \
+      } \
+      \
+      uint8_t choice = 0; \
+      if (distribution == DeepState_FloatEdges) { \
+        choice = DeepState_UChar(); \
+      } \
+      utype x = DeepState_ ## UType(); \
+      \
+      type v; \
+      if (distribution == DeepState_FloatUniform && \
+          low - low == 0 && high - high == 0) {  /* Both finite. */ \
+        const unsigned shift = sizeof(utype) * 8 > 53 ? \
+                               sizeof(utype) * 8 - 53 : 0; \
+        double t = (double) (x >> shift) / (double) (((utype) ~0) >> shift); \
+        v = (type) ((double) low * (1.0 - t) + (double) high * t); \
+      } else if (distribution == DeepState_FloatEdges && (choice & 1)) { \
+        utype key_zero = DeepState_ ## Type ## Key((type) 0); \
+        type edges[] = { \
+          low, high, \
+          DeepState_ ## Type ## FromKey(key_low + (key_low < key_high)), \
+          DeepState_ ## Type ## FromKey(key_high - (key_low < key_high)), \
+          (type) 0, -(type) 0, \
+          DeepState_ ## Type ## FromKey(key_zero + 1), \
+          DeepState_ ## Type ## FromKey(key_zero - 2), \
+          min, -min, (type) 1, (type) -1, max, -max, \
+          DeepState_ ## Type ## FromKey(DeepState_ ## Type ## Key(max) + 1), \
+          DeepState_ ## Type ## FromKey(DeepState_ ## Type ## Key(-max) - 1) \
+        }; \
+        v = edges[(choice >> 1) % (sizeof(edges) / sizeof(edges[0]))]; \
+      } else { \
+        v = DeepState_ ## Type ## FromKey( \
+            key_low + (utype) DeepState_ScaleToSpan( \
+                x, sizeof(utype), key_high - key_low)); \
+      } \
+      \
+      if (!(v >= low)) { \
+        v = low; \
+      } else if (!(v <= high)) { \
+        v = high; \
+      } \
+      return v; \
+    } \
+    \
+    type DeepState_ ## Type ## InRange(type low, type high) { \
+      return DeepState_ ## Type ## InRangeUsing(low, high, \
+                                                DeepState_FloatBits); \
     }
+
+MAKE_FLOAT_RANGE_FUNC(Float, float, UInt, uint32_t, 0x80000000U,
+                      FLT_MAX, FLT_MIN)
+MAKE_FLOAT_RANGE_FUNC(Double, double, UInt64, uint64_t, 0x8000000000000000ULL,
+                      DBL_MAX, DBL_MIN)
+
+#undef MAKE_FLOAT_RANGE_FUNC
+
+int32_t DeepState_RandInt() {
+  return DeepState_IntInRange(0, RAND_MAX);
+}
+
+/* Defines `DeepState_CompactRangesOn` or `DeepState_CompactRangesOff`. */
+const int DeepState_CompactRangesSetting = 1;
+
+uint64_t DeepState_CompactRange(uint64_t span) {
+  uint8_t bytes[8];
+  unsigned num_bytes = 1;
+  while (num_bytes < 8 && (span >> (8 * num_bytes))) {
+    num_bytes++;
+  }
+  DeepState_SymbolizeData(bytes, &(bytes[num_bytes]));
+
+  uint64_t x = 0;
+  for (unsigned i = 0; i < num_bytes; i++) {
+    x = (x << 8) | bytes[i];
+  }
+  return DeepState_ScaleToSpan(x, num_bytes, span);
+}
+
+/* Counts of every `ASSIGN_SATISFYING` call site that has searched, in memory
+ * shared with forked tests, so that their searches count too. Slots are
+ * claimed by site, and found again by hashing its address. */
+static struct DeepState_SearchStats *DeepState_SearchStatsTable = NULL;
+
+/* The number of tests begun, which tells apart the values each site cached
+ * in each test. */
+static unsigned long long DeepState_SearchEpoch = 0;
+
+static void DeepState_AllocSearchStats(void) {
+  void *mem = mmap(NULL, DEEPSTATE_MAX_SEARCH_SITES *
+                         sizeof(struct DeepState_SearchStats),
+                   PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+  if (mem != MAP_FAILED) {
+    DeepState_SearchStatsTable = (struct DeepState_SearchStats *) mem;
   }
-  int32_t int_v = DeepState_IntInRange(*(int32_t *)&low, *(int32_t *)&high);
-  float float_v = *(float*)&int_v;
-  assume (float_v >= low);
-  assume (float_v <= high);
-  return float_v;
 }
 
-double DeepState_DoubleInRange(double low, double high) {
-  if (low > high) {
-    return DeepState_DoubleInRange(high, low);
+/* Find the counts of `site`, claiming a slot for them if it has none. */
+static struct DeepState_SearchStats *DeepState_GetSearchStats(
+    struct DeepState_SearchSite *site, const char *file, unsigned line) {
+  if (site->stats != NULL || DeepState_SearchStatsTable == NULL) {
+    return site->stats;
+  }
+  unsigned start = (unsigned) (((uintptr_t) site >> 3) %
+                               DEEPSTATE_MAX_SEARCH_SITES);
+  for (unsigned i = 0; i < DEEPSTATE_MAX_SEARCH_SITES; i++) {
+    struct DeepState_SearchStats *stats =
+        &(DeepState_SearchStatsTable[(start + i) % DEEPSTATE_MAX_SEARCH_SITES]);
+    if (stats->site == site ||
+        __sync_bool_compare_and_swap(&(stats->site), NULL, site)) {
+      stats->file = file;
+      stats->line = line;
+      site->stats = stats;
+      break;
+    }
   }
-  if (low < 0.0) { // Handle negatives differently
-    if (high > 0.0) {
-      if (DeepState_Bool()) {
-	return -(DeepState_DoubleInRange(0.0, -low));
+  return site->stats;
+}
+
+/* Convert between the value of `v`, as an `unsigned long long`, and the
+ * encoding that the search works on. */
+static unsigned long long DeepState_SearchEncode(struct DeepState_Search *search,
+                                                 unsigned long long raw) {
+  return (raw + search->bias) & search->mask;
+}
+
+static unsigned long long DeepState_SearchDecode(struct DeepState_Search *search,
+                                                 unsigned long long encoded) {
+  unsigned long long raw = (encoded - search->bias) & search->mask;
+  if (search->is_signed && (raw & ~(search->mask >> 1))) {
+    raw |= ~search->mask;
+  }
+  return raw;
+}
+
+void DeepState_BeginSearch(struct DeepState_Search *search,
+                           struct DeepState_SearchSite *site,
+                           const char *file, unsigned line,
+                           enum DeepState_SearchStrategy strategy,
+                           unsigned long long budget, int is_signed,
+                           size_t size, unsigned long long start,
+                           int has_range, unsigned long long low,
+                           unsigned long long high) {
+  struct DeepState_SearchStats *stats =
+      DeepState_GetSearchStats(site, file, line);
+  if (stats != NULL) {
+    __sync_fetch_and_add(&(stats->num_searches), 1);
+  }
+
+  memset(search, 0, sizeof(*search));
+  search->site = site;
+  search->strategy = strategy;
+  search->budget = budget;
+  search->is_signed = is_signed;
+  search->mask = size >= sizeof(unsigned long long) ?
+                 ~0ULL : (1ULL << (8 * size)) - 1;
+  search->bias = is_signed ? (search->mask >> 1) + 1 : 0;
+  search->start = DeepState_SearchEncode(search, start);
+  search->low = has_range ? DeepState_SearchEncode(search, low) : 0;
+  search->high = has_range ? DeepState_SearchEncode(search, high) :
+                 search->mask;
+  search->current = search->start;
+  search->up = search->start;
+  search->down = search->start;
+  search->value = start;
+}
+
+/* The next value for a scan to try, alternating between values above and
+ * below the start. Returns 0 when the whole range has been tried. */
+static int DeepState_NextScanCandidate(struct DeepState_Search *search) {
+  int can_go_up = search->up < search->high;
+  int can_go_down = search->down > search->low;
+  if (can_go_up && (!can_go_down || (search->iters & 1))) {
+    search->current = ++search->up;
+  } else if (can_go_down) {
+    search->current = --search->down;
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+/* The next value for a bisection to try. The ends of the range are tried
+ * first, to know which side of the start the satisfying values are on.
+ * Then the boundary between those and the start is narrowed down. */
+static int DeepState_NextBisectCandidate(struct DeepState_Search *search,
+                                         int ok) {
+  unsigned long long distance;
+  switch (search->phase) {
+    case 0:  /* Try the top of the range. */
+      search->phase = 1;
+      if (search->start != search->high) {
+        search->current = search->high;
+        return 1;
+      }
+      /* Fall through. */
+    case 1:  /* Try the bottom of the range. */
+      if (ok && search->current == search->high) {
+        search->bisect_false = search->start;
+        search->bisect_true = search->high;
+        search->phase = 3;
+        break;
+      }
+      search->phase = 2;
+      if (search->start != search->low) {
+        search->current = search->low;
+        return 1;
+      }
+      return 0;
+    case 2:
+      if (!ok) {
+        return 0;
+      }
+      search->bisect_false = search->start;
+      search->bisect_true = search->low;
+      search->phase = 3;
+      break;
+    default:  /* Narrow down the boundary. */
+      if (ok) {
+        search->bisect_true = search->current;
       } else {
-	return DeepState_DoubleInRange(0.0, high);
+        search->bisect_false = search->current;
       }
-    } else {
-      return -(DeepState_DoubleInRange(-high, -low));
+      break;
+  }
+
+  if (search->bisect_true > search->bisect_false) {
+    distance = search->bisect_true - search->bisect_false;
+    search->current = search->bisect_false + distance / 2;
+  } else {
+    distance = search->bisect_false - search->bisect_true;
+    search->current = search->bisect_true + (distance + 1) / 2;
+  }
+  if (distance <= 1) {
+    search->current = search->bisect_true;
+    search->found = 1;
+    return 0;
+  }
+  return 1;
+}
+
+/* The next value for random probing to try. Values are derived from the
+ * start, so that a saved test finds the same value when replayed. */
+static int DeepState_NextRandomCandidate(struct DeepState_Search *search) {
+  uint64_t state = search->start ^ (search->iters * 0x2545f4914f6cdd1dULL);
+  unsigned long long x = DeepState_SplitMix64(&state);
+  unsigned long long span = search->high - search->low;
+  search->current = span == ~0ULL ? x : search->low + x % (span + 1);
+  return 1;
+}
+
+int DeepState_NextCandidate(struct DeepState_Search *search, int ok) {
+  if (search->done) {
+    return 0;
+  }
+
+  if (ok && (search->strategy != DeepState_SearchBisect ||
+             search->current == search->start)) {
+    search->found = 1;
+  } else if (search->iters >= search->budget) {
+    struct DeepState_SearchStats *stats = search->site->stats;
+    if (stats != NULL) {
+      __sync_fetch_and_add(&(stats->num_budget_hits), 1);
+      DeepState_LogFormat(DeepState_LogDebug,
+                          "Search at %s(%u) gave up after %llu tries",
+                          stats->file, stats->line, search->iters);
+    }
+
+    /* A bisection has already seen a satisfying value, if it got as far
+     * as narrowing down the boundary. */
+    if (search->strategy == DeepState_SearchBisect && search->phase == 3) {
+      search->current = search->bisect_true;
+      search->value = DeepState_SearchDecode(search, search->current);
+      search->found = 1;
+    }
+  } else {
+    struct DeepState_SearchSite *site = search->site;
+    int more = 0;
+    search->iters++;
+    switch (search->strategy) {
+      case DeepState_SearchBisect:
+        more = DeepState_NextBisectCandidate(search, ok);
+        break;
+      case DeepState_SearchRandom:
+        more = DeepState_NextRandomCandidate(search);
+        break;
+      case DeepState_SearchCached:
+        while (site->cache_epoch == DeepState_SearchEpoch &&
+               search->cache_index < site->cache_count) {
+          unsigned long long cached = site->cache[search->cache_index++];
+          if (search->low <= cached && cached <= search->high &&
+              cached != search->start) {
+            search->current = cached;
+            more = 1;
+            break;
+          }
+        }
+        if (!more) {
+          more = DeepState_NextScanCandidate(search);
+        }
+        break;
+      default:
+        more = DeepState_NextScanCandidate(search);
+        break;
+    }
+    search->value = DeepState_SearchDecode(search, search->current);
+    if (more) {
+      return 1;
     }
   }
-  int64_t int_v = DeepState_Int64InRange(*(int64_t *)&low, *(int64_t *)&high);
-  double double_v = *(double*)&int_v;
-  assume (double_v >= low);
-  assume (double_v <= high);
-  return double_v;
+
+  search->done = 1;
+  return 0;
 }
 
-int32_t DeepState_RandInt() {
-  return DeepState_IntInRange(0, RAND_MAX);
+int DeepState_EndSearch(struct DeepState_Search *search) {
+  struct DeepState_SearchSite *site = search->site;
+  if (!search->found) {
+    return 0;
+  }
+
+  /* Remember the value for later searches at this site in this test. */
+  if (site->cache_epoch != DeepState_SearchEpoch) {
+    site->cache_epoch = DeepState_SearchEpoch;
+    site->cache_count = 0;
+  }
+  if (site->cache_count < DEEPSTATE_SEARCH_CACHE_SIZE) {
+    site->cache_count++;
+  }
+  memmove(&(site->cache[1]), &(site->cache[0]),
+          (site->cache_count - 1) * sizeof(site->cache[0]));
+  site->cache[0] = search->current;
+  return 1;
+}
+
+/* Log how often each `ASSIGN_SATISFYING` call site ran out of tries. */
+static void DeepState_LogSearchBudgetHits(void) {
+  if (DeepState_SearchStatsTable == NULL) {
+    return;
+  }
+  for (unsigned i = 0; i < DEEPSTATE_MAX_SEARCH_SITES; i++) {
+    struct DeepState_SearchStats *stats = &(DeepState_SearchStatsTable[i]);
+    if (stats->site != NULL && stats->num_budget_hits) {
+      DeepState_LogFormat(DeepState_LogWarning,
+                          "Search at %s(%u) ran out of tries in %llu of %llu "
+                          "searches", stats->file, stats->line,
+                          stats->num_budget_hits, stats->num_searches);
+    }
+  }
 }
 
 /* Returns the minimum satisfiable value for a given symbolic value, given
@@ -673,17 +1562,13 @@ int32_t DeepState_MaxInt(int32_t v) {
 
 /* Function to clean up generated strings, and any other DeepState-managed data. */
 extern void DeepState_CleanUp() {
-  for (int i = 0; i < DeepState_GeneratedAllocsIndex; i++) {
-    free(DeepState_GeneratedAllocs[i]);
-  }
-  DeepState_GeneratedAllocsIndex = 0;
-  
-  for (int i = 0; i < DeepState_SwarmConfigsIndex; i++) {
-    free(DeepState_SwarmConfigs[i]->file);
-    free(DeepState_SwarmConfigs[i]->fmap);
-    free(DeepState_SwarmConfigs[i]);
-  }
+  DeepState_ArenaReset();
+  DeepState_DropLog();
+
+  /* Swarm configurations are reused by the next test to make one. */
   DeepState_SwarmConfigsIndex = 0;
+
+  DeepState_ResetStreams();
 }
 
 void _DeepState_Assume(int expr, const char *expr_str, const char *file,
@@ -735,8 +1620,8 @@ const struct DeepState_IndexEntry DeepState_API[] = {
   {"LastTestInfo",    (void *) &DeepState_LastTestInfo},
 
   /* Source of symbolic bytes. */
-  {"InputBegin",      (void *) &(DeepState_Input[0])},
-  {"InputEnd",        (void *) &(DeepState_Input[DeepState_InputSize])},
+  {"InputBegin",      (void *) &(DeepState_InputStorage[0])},
+  {"InputEnd",        (void *) &(DeepState_InputStorage[DEEPSTATE_SIZE])},
   {"InputIndex",      (void *) &DeepState_InputIndex},
 
   /* Solver APIs. */
@@ -767,10 +1652,12 @@ const struct DeepState_IndexEntry DeepState_API[] = {
 DEEPSTATE_NOINLINE
 void DeepState_Setup(void) {
   static int was_setup = 0;
-  if (!was_setup) {
-    DeepState_AllocCurrentTestRun();
-    was_setup = 1;
+  if (was_setup) {
+    return;  /* E.g., a harness `main` and then `LLVMFuzzerInitialize`. */
   }
+  DeepState_AllocCurrentTestRun();
+  DeepState_AllocSearchStats();
+  was_setup = 1;
 
   /* Sort the test cases by line number. */
   struct DeepState_TestInfo *current = DeepState_LastTestInfo;
@@ -789,21 +1676,246 @@ void DeepState_Setup(void) {
 
 /* Tear down DeepState. */
 void DeepState_Teardown(void) {
-
+  static int was_torn_down = 0;
+  if (was_torn_down) {
+    return;  /* E.g., a harness `main` and then the libFuzzer `atexit`. */
+  }
+  was_torn_down = 1;
+  DeepState_StopForkServer();
+  DeepState_LogSearchBudgetHits();
 }
 
 /* Notify that we're about to begin a test. */
 void DeepState_Begin(struct DeepState_TestInfo *test) {
   DeepState_InitCurrentTestRun(test);
+  DeepState_SearchEpoch++;
+  DeepState_NumExhaustedBytes = 0;
+  if (HAS_FLAG_trace_reads) {
+    if (DeepState_ReadTrace == NULL) {
+      DeepState_OpenReadTrace();
+    }
+    if (DeepState_ReadTrace != NULL) {
+      DeepState_ReadTrace->count = 0;
+    }
+  }
   DeepState_LogFormat(DeepState_LogTrace, "Running: %s from %s(%u)",
                       test->test_name, test->file_name, test->line_number);
 }
 
-/* Save a failing test. */
+/* A request from the test harness to the fork server to run `test`. The
+ * first `input_size` bytes of input for the test are in
+ * `DeepState_ForkServerInput`, and the rest are zeros, or are generated from
+ * `input_gen_state` after the first `input_generated` bytes. */
+struct DeepState_ForkServerRequest {
+  struct DeepState_TestInfo *test;
+  uint64_t input_gen_state;
+  uint32_t input_generated;
+  uint32_t input_size;
+};
+
+/* The fork server's reply to a request. */
+struct DeepState_ForkServerReply {
+  int forked;   /* Did the server fork a process to run the test? */
+  int wstatus;  /* Status of the test process, as given by `waitpid`. */
+};
+
+/* The fork server is a child of the test harness that forks a new process
+ * for each test it is asked to run. Each one belongs to the process that
+ * started it; forked workers start their own. */
+static pid_t DeepState_ForkServerPid = -1;
+static pid_t DeepState_ForkServerOwner = -1;
+static int DeepState_ForkServerControlFd = -1;
+static int DeepState_ForkServerStatusFd = -1;
+
+/* Shared with the fork server, to pass it the input for each test. The
+ * server is restarted if the input buffer changes size. */
+static volatile uint8_t *DeepState_ForkServerInput = NULL;
+static uint32_t DeepState_ForkServerInputSize = 0;
+
+/* Read or write exactly `size` bytes, retrying if interrupted. Returns
+ * `false` if the other end of the pipe is gone. */
+static bool DeepState_ReadFully(int fd, void *data, size_t size) {
+  uint8_t *bytes = (uint8_t *) data;
+  while (size) {
+    ssize_t count = read(fd, bytes, size);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count <= 0) {
+      return false;
+    }
+    bytes += count;
+    size -= (size_t) count;
+  }
+  return true;
+}
+
+static bool DeepState_WriteFully(int fd, const void *data, size_t size) {
+  const uint8_t *bytes = (const uint8_t *) data;
+  while (size) {
+    ssize_t count = write(fd, bytes, size);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    } else if (count <= 0) {
+      return false;
+    }
+    bytes += count;
+    size -= (size_t) count;
+  }
+  return true;
+}
+
+/* Runs in the fork server: fork a process for each test we're asked to run,
+ * and report back how it ended. The server exits once the test harness
+ * closes its end of the control pipe. */
+DEEPSTATE_NORETURN
+static void DeepState_RunForkServer(int control_fd, int status_fd) {
+  struct DeepState_ForkServerRequest request;
+  while (DeepState_ReadFully(control_fd, &request, sizeof(request))) {
+    struct DeepState_ForkServerReply reply = {0, 0};
+    pid_t test_pid = fork();
+    if (!test_pid) {
+      close(control_fd);
+      close(status_fd);
+      memcpy((void *) DeepState_Input, (void *) DeepState_ForkServerInput,
+             request.input_size);
+      DeepState_ClearInputFrom(request.input_size);
+      DeepState_InputGenState = request.input_gen_state;
+      DeepState_InputGenerated = request.input_generated;
+      DeepState_InputIndex = 0;
+      DeepState_SwarmConfigsIndex = 0;
+      DeepState_RunTest(request.test);
+    } else if (test_pid > 0) {
+      reply.forked = 1;
+      waitpid(test_pid, &reply.wstatus, 0);
+    }
+    if (!DeepState_WriteFully(status_fd, &reply, sizeof(reply))) {
+      break;
+    }
+  }
+  _exit(0);
+}
+
+/* Stop the fork server started by this process, if any. If the server was
+ * inherited from a parent process, just forget about it. */
+void DeepState_StopForkServer(void) {
+  if (DeepState_ForkServerPid < 0) {
+    return;
+  }
+  close(DeepState_ForkServerControlFd);
+  close(DeepState_ForkServerStatusFd);
+  if (DeepState_ForkServerOwner == getpid()) {
+    waitpid(DeepState_ForkServerPid, NULL, 0);
+  }
+  munmap((void *) DeepState_ForkServerInput, DeepState_ForkServerInputSize);
+  DeepState_ForkServerInput = NULL;
+  DeepState_ForkServerInputSize = 0;
+  DeepState_ForkServerControlFd = -1;
+  DeepState_ForkServerStatusFd = -1;
+  DeepState_ForkServerPid = -1;
+  DeepState_ForkServerOwner = -1;
+}
+
+/* Start a fork server for this process. */
+static bool DeepState_StartForkServer(void) {
+  int control_fds[2];
+  int status_fds[2];
+
+  void *shared_mem = mmap(NULL, DeepState_InputSize, PROT_READ | PROT_WRITE,
+                          MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+  if (shared_mem == MAP_FAILED) {
+    return false;
+  }
+  if (pipe(control_fds)) {
+    munmap(shared_mem, DeepState_InputSize);
+    return false;
+  }
+  if (pipe(status_fds)) {
+    close(control_fds[0]);
+    close(control_fds[1]);
+    munmap(shared_mem, DeepState_InputSize);
+    return false;
+  }
+
+  DeepState_ForkServerInput = (volatile uint8_t *) shared_mem;
+  DeepState_ForkServerInputSize = DeepState_InputSize;
+  pid_t server_pid = fork();
+  if (!server_pid) {
+    close(control_fds[1]);
+    close(status_fds[0]);
+    DeepState_RunForkServer(control_fds[0], status_fds[1]);
+  }
+
+  close(control_fds[0]);
+  close(status_fds[1]);
+  DeepState_ForkServerPid = server_pid;
+  DeepState_ForkServerOwner = getpid();
+  DeepState_ForkServerControlFd = control_fds[1];
+  DeepState_ForkServerStatusFd = status_fds[0];
+
+  if (server_pid < 0) {
+    DeepState_Log(DeepState_LogWarning, "Unable to fork the fork server");
+    DeepState_StopForkServer();
+    return false;
+  }
+  return true;
+}
+
+/* Run `test` on the current input in a process forked by the fork server,
+ * starting the server first if this process doesn't have one. Returns
+ * `false` if the server could not run the test, in which case the caller
+ * should fork the test itself. */
+bool DeepState_ForkServerRunTest(struct DeepState_TestInfo *test,
+                                 int *wstatus) {
+  if (DeepState_ForkServerOwner != getpid() ||
+      DeepState_ForkServerInputSize != DeepState_InputSize) {
+    DeepState_StopForkServer();
+    if (!DeepState_StartForkServer()) {
+      return false;
+    }
+  }
+
+  struct DeepState_ForkServerRequest request = {
+      test, DeepState_InputGenState, DeepState_InputGenerated,
+      DeepState_InputGenerated < DeepState_InputDirtySize ?
+          DeepState_InputGenerated : DeepState_InputDirtySize};
+  struct DeepState_ForkServerReply reply = {0, 0};
+
+  memcpy((void *) DeepState_ForkServerInput, (void *) DeepState_Input,
+         request.input_size);
+
+  /* Ignore `SIGPIPE` while sending the request, so that a server that has
+   * exited shows up as `EPIPE` rather than killing us. */
+  struct sigaction ignore_sigpipe, old_sigpipe;
+  memset(&ignore_sigpipe, 0, sizeof(ignore_sigpipe));
+  ignore_sigpipe.sa_handler = SIG_IGN;
+  sigemptyset(&ignore_sigpipe.sa_mask);
+  sigaction(SIGPIPE, &ignore_sigpipe, &old_sigpipe);
+  bool sent = DeepState_WriteFully(DeepState_ForkServerControlFd, &request,
+                                   sizeof(request));
+  int write_errno = errno;
+  sigaction(SIGPIPE, &old_sigpipe, NULL);
+
+  /* The next test starts a new server. */
+  if (!sent && write_errno == EPIPE) {
+    DeepState_Log(DeepState_LogWarning,
+                  "The fork server exited; forking the test without it");
+    DeepState_StopForkServer();
+    return false;
+  } else if (!sent || !DeepState_ReadFully(DeepState_ForkServerStatusFd,
+                                           &reply, sizeof(reply))) {
+    DeepState_Log(DeepState_LogWarning, "Lost contact with the fork server");
+    DeepState_StopForkServer();
+    return false;
+  }
+
+  *wstatus = reply.wstatus;
+  return reply.forked;
+}
 
 /* Runs in a child process, under the control of Dr. Memory */
 void DrMemFuzzFunc(volatile uint8_t *buff, size_t size) {
   struct DeepState_TestInfo *test = DeepState_DrFuzzTest;
+  DeepState_InputDirtySize = DeepState_InputSize;
   DeepState_InputIndex = 0;
   DeepState_SwarmConfigsIndex = 0;
   DeepState_InitCurrentTestRun(test);
@@ -957,63 +2069,188 @@ void DeepState_BeginDrFuzz(struct DeepState_TestInfo *test) {
   DrMemFuzzFunc(DeepState_Input, DeepState_InputSize);
 }
 
-/* Right now "fake" a hexdigest by just using random bytes.  Not ideal. */
-void makeFilename(char *name, size_t size) {
-  const char *entities = "0123456789abcdef";
-  for (int i = 0; i < size; i++) {
-    name[i] = entities[rand()%16];
+/* Round constants and shift amounts of MD5 (RFC 1321). */
+static const uint32_t DeepState_MD5Constants[64] = {
+  0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+  0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+  0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+  0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+  0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+  0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+  0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+  0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+  0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+  0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+  0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+  0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+  0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+  0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+  0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+  0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const uint8_t DeepState_MD5Shifts[64] = {
+  7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+  5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+  4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+  6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+/* Mix one 64-byte block into the MD5 state `h`. */
+static void DeepState_MD5Block(uint32_t h[4], const uint8_t *block) {
+  uint32_t w[16];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t) block[4 * i]) |
+           (((uint32_t) block[4 * i + 1]) << 8) |
+           (((uint32_t) block[4 * i + 2]) << 16) |
+           (((uint32_t) block[4 * i + 3]) << 24);
+  }
+
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+  for (int i = 0; i < 64; i++) {
+    uint32_t f, g;
+    if (i < 16) {
+      f = (b & c) | (~b & d);
+      g = i;
+    } else if (i < 32) {
+      f = (d & b) | (~d & c);
+      g = (5 * i + 1) % 16;
+    } else if (i < 48) {
+      f = b ^ c ^ d;
+      g = (3 * i + 5) % 16;
+    } else {
+      f = c ^ (b | ~d);
+      g = (7 * i) % 16;
+    }
+    uint32_t rotated = a + f + DeepState_MD5Constants[i] + w[g];
+    uint8_t shift = DeepState_MD5Shifts[i];
+    a = d;
+    d = c;
+    c = b;
+    b = b + ((rotated << shift) | (rotated >> (32 - shift)));
   }
+
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
 }
 
-void writeInputData(char* name, int important) {
+/* Write the MD5 digest of `size` bytes of `data`, as 32 hex characters and a
+ * null terminator, to `hex`. */
+static void DeepState_MD5Hex(const uint8_t *data, size_t size, char *hex) {
+  uint32_t h[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+  uint8_t block[64];
+  size_t i = 0;
+
+  for (; i + 64 <= size; i += 64) {
+    DeepState_MD5Block(h, &(data[i]));
+  }
+
+  /* Pad the last block with a one bit, zeros, and the length in bits. */
+  size_t rest = size - i;
+  memset(block, 0, sizeof(block));
+  memcpy(block, &(data[i]), rest);
+  block[rest] = 0x80;
+  if (rest >= 56) {
+    DeepState_MD5Block(h, block);
+    memset(block, 0, sizeof(block));
+  }
+  uint64_t num_bits = ((uint64_t) size) * 8;
+  for (int j = 0; j < 8; j++) {
+    block[56 + j] = (uint8_t) (num_bits >> (8 * j));
+  }
+  DeepState_MD5Block(h, block);
+
+  const char *entities = "0123456789abcdef";
+  for (int j = 0; j < 16; j++) {
+    uint8_t byte = (uint8_t) (h[j / 4] >> (8 * (j % 4)));
+    hex[2 * j] = entities[byte >> 4];
+    hex[2 * j + 1] = entities[byte & 0xf];
+  }
+  hex[32] = 0;
+}
+
+/* Save the first `size` bytes of the input to the output test directory.
+ * Like the symbolic executors, we name the file by the MD5 digest of its
+ * contents, followed by `extension`, so that a test that has already been
+ * saved is not saved again. The input is written to a temporary file first
+ * and then linked into place, so that a failed write, or a worker killed
+ * mid-write, never leaves a truncated file under the digest's name. */
+static void DeepState_SaveInput(size_t size, const char *extension,
+                                int important) {
+  char name[48];
+  DeepState_MD5Hex((const uint8_t *) DeepState_Input, size, name);
+  strncat(name, extension, sizeof(name) - strlen(name) - 1);
+
   size_t path_len = 2 + sizeof(char) * (strlen(FLAGS_output_test_dir) + strlen(name));
+  size_t temp_path_len = path_len + 32;
   char *path = (char *) malloc(path_len);
+  char *temp_path = (char *) malloc(temp_path_len);
+  if (path == NULL || temp_path == NULL) {
+    DeepState_Log(DeepState_LogError, "Unable to allocate test case path");
+    free(path);
+    free(temp_path);
+    return;
+  }
   snprintf(path, path_len, "%s/%s", FLAGS_output_test_dir, name);
-  FILE *fp = fopen(path, "wb");
-  if (fp == NULL) {
-    DeepState_LogFormat(DeepState_LogError, "Failed to create file `%s`", path);
+
+  /* The leading `.` keeps replay from picking up a stale temporary file. */
+  snprintf(temp_path, temp_path_len, "%s/.%s.%d.tmp", FLAGS_output_test_dir,
+           name, (int) getpid());
+  enum DeepState_LogLevel level =
+      important ? DeepState_LogInfo : DeepState_LogTrace;
+
+  int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    DeepState_LogFormat(DeepState_LogError, "Failed to create file `%s`", temp_path);
+    free(temp_path);
     free(path);
     return;
   }
-  size_t written = fwrite((void *)DeepState_Input, 1, DeepState_InputSize, fp);
-  if (written != DeepState_InputSize) {
-    DeepState_LogFormat(DeepState_LogError, "Failed to write to file `%s`", path);
-  } else {
-    if (important) {
-      DeepState_LogFormat(DeepState_LogInfo, "Saved test case in file `%s`", path);
+  bool written = DeepState_WriteFully(fd, (const void *) DeepState_Input, size);
+  if (close(fd)) {
+    written = false;
+  }
+
+  if (!written) {
+    DeepState_LogFormat(DeepState_LogError, "Failed to write to file `%s`", temp_path);
+  } else if (link(temp_path, path)) {
+    if (errno == EEXIST) {
+      DeepState_LogFormat(level, "Test case already saved in file `%s`", path);
     } else {
-      DeepState_LogFormat(DeepState_LogTrace, "Saved test case in file `%s`", path);
+      DeepState_LogFormat(DeepState_LogError, "Failed to create file `%s`", path);
     }
+  } else {
+    DeepState_LogFormat(level, "Saved test case in file `%s`", path);
   }
+  unlink(temp_path);
+  free(temp_path);
   free(path);
-  fclose(fp);
 }
 
-/* Save a passing test to the output test directory. */
+/* Save a passing test to the output test directory. Only the input that the
+ * test consumed is saved. */
 void DeepState_SavePassingTest(void) {
-  char name[48];
-  makeFilename(name, 40);
-  name[40] = 0;
-  strncat(name, ".pass", 48);
-  writeInputData(name, 0);
+  DeepState_SaveInput(DeepState_InputIndex, ".pass", 0);
 }
 
 /* Save a failing test to the output test directory. */
 void DeepState_SaveFailingTest(void) {
-  char name[48];
-  makeFilename(name, 40);
-  name[40] = 0;
-  strncat(name, ".fail", 48);
-  writeInputData(name, 1);
+  DeepState_SaveInput(DeepState_InputIndex, ".fail", 1);
 }
 
-/* Save a crashing test to the output test directory. */
+/* Save a crashing test to the output test directory. The test crashed in
+ * another process, so we don't know how much input it consumed, and save
+ * all of it instead. Replay pads inputs with zeros, so trailing zeros are
+ * left out. */
 void DeepState_SaveCrashingTest(void) {
-  char name[48];
-  makeFilename(name, 40);
-  name[40] = 0;
-  strncat(name, ".crash", 48);
-  writeInputData(name, 1);
+  DeepState_GenerateInput(DeepState_InputSize);
+  uint32_t size = DeepState_InputSize;
+  while (size > 0 && !DeepState_InputBytes[size - 1]) {
+    size--;
+  }
+  DeepState_SaveInput(size, ".crash", 1);
 }
 
 /* Return the first test case to run. */
@@ -1031,6 +2268,307 @@ bool DeepState_CatchAbandoned(void) {
   return DeepState_CurrentTestRun->result == DeepState_TestRunAbandon;
 }
 
+/* Seed the generator of fuzzing inputs. */
+static void DeepState_SeedFuzzer(unsigned int seed) {
+  uint64_t state = seed;
+  DeepState_FuzzSeed = DeepState_SplitMix64(&state);
+  DeepState_FuzzNumTests = 0;
+}
+
+/* Counts of the tests run by one fuzzing process. When fuzzing with several
+ * workers, each one has its own counts in shared memory, and the parent
+ * process adds them up. */
+struct DeepState_FuzzStats {
+  unsigned int num_tests;
+  int num_failed_tests;
+  int num_passed_tests;
+  int num_abandoned_tests;
+};
+
+/* Memory shared by the fuzzing workers and the process that started them. */
+struct DeepState_FuzzShared {
+  volatile int stop;  /* Set to ask the workers to stop. */
+  struct DeepState_FuzzStats stats[];
+};
+
+/* How long, in microseconds, workers get to stop when asked to, and then to
+ * exit after `SIGTERM`, before they are killed. */
+#define DEEPSTATE_WORKER_GRACE_PERIOD 1000000
+
+/* The signal that interrupted fuzzing with workers, if any. */
+static volatile sig_atomic_t DeepState_FuzzInterrupted = 0;
+
+static void DeepState_InterruptFuzzing(int signum) {
+  DeepState_FuzzInterrupted = signum;
+}
+
+/* Add up the stats of `num_workers` fuzzing workers. */
+static struct DeepState_FuzzStats
+DeepState_TotalFuzzStats(const struct DeepState_FuzzStats *stats,
+                         unsigned num_workers) {
+  struct DeepState_FuzzStats total = {0, 0, 0, 0};
+  for (unsigned w = 0; w < num_workers; w++) {
+    total.num_tests += stats[w].num_tests;
+    total.num_failed_tests += stats[w].num_failed_tests;
+    total.num_passed_tests += stats[w].num_passed_tests;
+    total.num_abandoned_tests += stats[w].num_abandoned_tests;
+  }
+  return total;
+}
+
+/* Log the periodic fuzzing status line, `diff` seconds into fuzzing. */
+static void DeepState_LogFuzzStatus(const struct DeepState_FuzzStats *stats,
+                                    unsigned diff) {
+  time_t t = time(NULL);
+  struct tm tm = *localtime(&t);
+  DeepState_LogFormat(DeepState_LogInfo, "%d-%02d-%02d %02d:%02d:%02d: %u tests/second: %d failed/%d passed/%d abandoned",
+		      tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, stats->num_tests/diff,
+		      stats->num_failed_tests, stats->num_passed_tests, stats->num_abandoned_tests);
+}
+
+/* Log the final fuzzing summary, after `diff` seconds of fuzzing. */
+static void DeepState_LogFuzzDone(const struct DeepState_FuzzStats *stats,
+                                  unsigned diff) {
+  DeepState_LogFormat(DeepState_LogInfo, "Done fuzzing! Ran %u tests (%u tests/second) with %d failed/%d passed/%d abandoned tests",
+		      stats->num_tests, diff ? stats->num_tests/diff : stats->num_tests,
+		      stats->num_failed_tests, stats->num_passed_tests, stats->num_abandoned_tests);
+}
+
+/* Fuzz `test` from `start` until `FLAGS_timeout` seconds have passed, or
+ * until `*stop` is set, counting results in `stats`. Returns the number of
+ * seconds spent. */
+static unsigned DeepState_FuzzUntilTimeout(struct DeepState_TestInfo *test,
+                                           struct DeepState_FuzzStats *stats,
+                                           long start, bool log_status,
+                                           const volatile int *stop) {
+  long current = (long)time(NULL);
+  unsigned diff = current-start;
+  unsigned int last_status = 0;
+
+  while (diff < FLAGS_timeout && !(stop != NULL && *stop)) {
+    stats->num_tests++;
+    if (log_status && (diff != last_status) && ((diff % 30) == 0) ) {
+      DeepState_LogFuzzStatus(stats, diff);
+      last_status = diff;
+    }
+    enum DeepState_TestRunResult result = DeepState_FuzzOneTestCase(test);
+    if ((result == DeepState_TestRunFail) || (result == DeepState_TestRunCrash)) {
+      stats->num_failed_tests++;
+    } else if (result == DeepState_TestRunPass) {
+      stats->num_passed_tests++;
+    } else if (result == DeepState_TestRunAbandon) {
+      stats->num_abandoned_tests++;
+    }
+
+    current = (long)time(NULL);
+    diff = current-start;
+  }
+  return diff;
+}
+
+/* Reap the workers in `worker_pids` that have exited, waiting up to `usecs`
+ * microseconds for all of them to exit. Returns the number still running. */
+static unsigned DeepState_ReapFuzzWorkers(pid_t *worker_pids,
+                                          unsigned num_workers, long usecs) {
+  while (true) {
+    unsigned num_live = 0;
+    for (unsigned w = 0; w < num_workers; w++) {
+      if (worker_pids[w] > 0) {
+        if (waitpid(worker_pids[w], NULL, WNOHANG) == worker_pids[w]) {
+          worker_pids[w] = -1;
+        } else {
+          num_live++;
+        }
+      }
+    }
+    if (!num_live || usecs <= 0) {
+      return num_live;
+    }
+    usleep(10000);
+    usecs -= 10000;
+  }
+}
+
+/* Stop the workers that are still running. They are first asked to stop
+ * after their current test; the ones that don't are sent `SIGTERM`, and then
+ * `SIGKILL`. Each worker leads its own process group, so the signals also
+ * reach the worker's test processes and fork server. */
+static void DeepState_StopFuzzWorkers(struct DeepState_FuzzShared *shared,
+                                      pid_t *worker_pids,
+                                      unsigned num_workers) {
+  shared->stop = 1;
+  if (!DeepState_ReapFuzzWorkers(worker_pids, num_workers,
+                                 DEEPSTATE_WORKER_GRACE_PERIOD)) {
+    return;
+  }
+
+  pid_t *groups = (pid_t *) malloc(num_workers * sizeof(pid_t));
+  if (groups == NULL) {
+    DeepState_Abandon("Error allocating memory");
+  }
+  for (unsigned w = 0; w < num_workers; w++) {
+    groups[w] = worker_pids[w];
+    if (groups[w] > 0) {
+      kill(-groups[w], SIGTERM);
+    }
+  }
+  DeepState_ReapFuzzWorkers(worker_pids, num_workers,
+                            DEEPSTATE_WORKER_GRACE_PERIOD);
+
+  /* Kill whatever is left of the groups, even when the worker itself has
+   * exited. */
+  for (unsigned w = 0; w < num_workers; w++) {
+    if (groups[w] > 0) {
+      kill(-groups[w], SIGKILL);
+    }
+    if (worker_pids[w] > 0) {
+      waitpid(worker_pids[w], NULL, 0);
+      worker_pids[w] = -1;
+    }
+  }
+  free(groups);
+}
+
+/* Fuzz `test` in `FLAGS_num_workers` worker processes, each seeded with a
+ * different seed derived from `seed`. The workers count their results in
+ * shared memory, and this process reports on them as a whole. */
+static int DeepState_FuzzInWorkers(struct DeepState_TestInfo *test,
+                                   unsigned int seed) {
+  unsigned num_workers = FLAGS_num_workers;
+  size_t shared_size = sizeof(struct DeepState_FuzzShared) +
+                       num_workers * sizeof(struct DeepState_FuzzStats);
+  void *shared_mem = mmap(NULL, shared_size, PROT_READ | PROT_WRITE,
+                          MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+  if (shared_mem == MAP_FAILED) {
+    DeepState_Log(DeepState_LogError, "Unable to map shared memory");
+    exit(1);
+  }
+  struct DeepState_FuzzShared *shared =
+      (struct DeepState_FuzzShared *) shared_mem;
+  struct DeepState_FuzzStats *stats = shared->stats;
+
+  pid_t *worker_pids = (pid_t *) malloc(num_workers * sizeof(pid_t));
+  if (worker_pids == NULL) {
+    DeepState_Abandon("Error allocating memory");
+  }
+
+  long start = (long)time(NULL);
+  unsigned num_live = 0;
+
+  for (unsigned w = 0; w < num_workers; w++) {
+    unsigned int worker_seed = seed + w * 2654435761u;
+    worker_pids[w] = fork();
+    if (!worker_pids[w]) {
+      setpgid(0, 0);
+
+      /* The inherited test run info is shared with every other worker, and
+       * so might be the ring that holds back the log. */
+      DeepState_AllocCurrentTestRun();
+      DeepState_UseLog(NULL);
+      DeepState_SeedFuzzer(worker_seed);
+      DeepState_FuzzUntilTimeout(test, &(stats[w]), start, false,
+                                 &(shared->stop));
+      DeepState_StopForkServer();
+      exit(0);
+    } else if (worker_pids[w] < 0) {
+      DeepState_LogFormat(DeepState_LogError,
+                          "Unable to fork fuzzing worker %u", w);
+    } else {
+      /* Also set here, so that the group exists before we signal it. */
+      setpgid(worker_pids[w], worker_pids[w]);
+      DeepState_LogFormat(DeepState_LogInfo,
+                          "Started fuzzing worker %u with seed %u",
+                          w, worker_seed);
+      num_live++;
+    }
+  }
+
+  /* The workers aren't in the terminal's process group, so pass an
+   * interrupt on to them by stopping them. Signals that were ignored stay
+   * ignored. */
+  struct sigaction interrupt, old_sigint, old_sigterm;
+  memset(&interrupt, 0, sizeof(interrupt));
+  interrupt.sa_handler = DeepState_InterruptFuzzing;
+  sigemptyset(&interrupt.sa_mask);
+  sigaction(SIGINT, NULL, &old_sigint);
+  sigaction(SIGTERM, NULL, &old_sigterm);
+  if (old_sigint.sa_handler != SIG_IGN) {
+    sigaction(SIGINT, &interrupt, NULL);
+  }
+  if (old_sigterm.sa_handler != SIG_IGN) {
+    sigaction(SIGTERM, &interrupt, NULL);
+  }
+
+  unsigned diff = 0;
+  unsigned int last_status = 0;
+  bool exit_on_fail = false;
+  bool abort_on_fail = false;
+
+  while (num_live > 0 && !exit_on_fail && !abort_on_fail &&
+         !DeepState_FuzzInterrupted) {
+    for (unsigned w = 0; w < num_workers; w++) {
+      int wstatus = 0;
+      if (worker_pids[w] <= 0 ||
+          waitpid(worker_pids[w], &wstatus, WNOHANG) != worker_pids[w]) {
+        continue;
+      }
+      worker_pids[w] = -1;
+      num_live--;
+
+      /* Workers stop themselves on failures with `--exit_on_fail` or
+       * `--abort_on_fail`, in which case we must stop too. */
+      if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 255 &&
+          FLAGS_exit_on_fail) {
+        exit_on_fail = true;
+      } else if (!WIFEXITED(wstatus) && FLAGS_abort_on_fail) {
+        abort_on_fail = true;
+      } else if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus)) {
+        DeepState_LogFormat(DeepState_LogError,
+                            "Fuzzing worker %u exited unexpectedly", w);
+      }
+    }
+
+    diff = (long)time(NULL) - start;
+    if ((diff != last_status) && ((diff % 30) == 0)) {
+      struct DeepState_FuzzStats total =
+          DeepState_TotalFuzzStats(stats, num_workers);
+      DeepState_LogFuzzStatus(&total, diff);
+      last_status = diff;
+    }
+
+    /* Don't wait long for workers stuck in a test past the timeout. */
+    if (diff > FLAGS_timeout) {
+      break;
+    }
+    if (num_live > 0) {
+      usleep(10000);
+    }
+  }
+
+  DeepState_StopFuzzWorkers(shared, worker_pids, num_workers);
+
+  struct DeepState_FuzzStats total = DeepState_TotalFuzzStats(stats, num_workers);
+  DeepState_LogFuzzDone(&total, (long)time(NULL) - start);
+
+  free(worker_pids);
+  munmap(shared_mem, shared_size);
+
+  sigaction(SIGINT, &old_sigint, NULL);
+  sigaction(SIGTERM, &old_sigterm, NULL);
+  if (DeepState_FuzzInterrupted) {
+    raise(DeepState_FuzzInterrupted);
+  }
+
+  if (abort_on_fail) {
+    DeepState_HardCrash();
+  }
+  if (exit_on_fail) {
+    exit(255); // Terminate the testing
+  }
+
+  return total.num_failed_tests;
+}
+
 /* Fuzz test `FLAGS_input_which_test` or first test, if not defined.
    Has to be defined here since we redefine rand in the header. */
 int DeepState_Fuzz(void){
@@ -1040,22 +2578,12 @@ int DeepState_Fuzz(void){
     FLAGS_min_log_level = 2;
   }
 
-  if (HAS_FLAG_seed) {
-    srand(FLAGS_seed);
-  } else {
-    unsigned int seed = time(NULL);
+  unsigned int seed = FLAGS_seed;
+  if (!HAS_FLAG_seed) {
+    seed = time(NULL);
     DeepState_LogFormat(DeepState_LogWarning, "No seed provided; using %u", seed);
-    srand(seed);
   }
-
-  long start = (long)time(NULL);
-  long current = (long)time(NULL);
-  unsigned diff = 0;
-  unsigned int i = 0;
-
-  int num_failed_tests = 0;
-  int num_passed_tests = 0;
-  int num_abandoned_tests = 0;
+  DeepState_SeedFuzzer(seed);
 
   struct DeepState_TestInfo *test = NULL;
 
@@ -1080,34 +2608,16 @@ int DeepState_Fuzz(void){
     return 0;
   }
 
-  unsigned int last_status = 0;
-
-  while (diff < FLAGS_timeout) {
-    i++;
-    if ((diff != last_status) && ((diff % 30) == 0) ) {
-      time_t t = time(NULL);
-      struct tm tm = *localtime(&t);
-      DeepState_LogFormat(DeepState_LogInfo, "%d-%02d-%02d %02d:%02d:%02d: %u tests/second: %d failed/%d passed/%d abandoned",
-			  tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, i/diff,
-			  num_failed_tests, num_passed_tests, num_abandoned_tests);
-      last_status = diff;
-    }
-    enum DeepState_TestRunResult result = DeepState_FuzzOneTestCase(test);
-    if ((result == DeepState_TestRunFail) || (result == DeepState_TestRunCrash)) {
-      num_failed_tests++;
-    } else if (result == DeepState_TestRunPass) {
-      num_passed_tests++;
-    } else if (result == DeepState_TestRunAbandon) {
-      num_abandoned_tests++;
-    }
-
-    current = (long)time(NULL);
-    diff = current-start;
+  if (FLAGS_num_workers > 1) {
+    return DeepState_FuzzInWorkers(test, seed);
   }
 
-  DeepState_LogFormat(DeepState_LogInfo, "Done fuzzing! Ran %u tests (%u tests/second) with %d failed/%d passed/%d abandoned tests",
-		      i, i/diff, num_failed_tests, num_passed_tests, num_abandoned_tests);
-  return num_failed_tests;
+  struct DeepState_FuzzStats stats = {0, 0, 0, 0};
+  unsigned diff = DeepState_FuzzUntilTimeout(test, &stats, (long)time(NULL),
+                                             true, NULL);
+
+  DeepState_LogFuzzDone(&stats, diff);
+  return stats.num_failed_tests;
 }
 
 
@@ -1117,9 +2627,12 @@ enum DeepState_TestRunResult DeepState_FuzzOneTestCase(struct DeepState_TestInfo
   DeepState_InputIndex = 0;
   DeepState_SwarmConfigsIndex = 0;
 
-  for (int i = 0; i < DeepState_InputSize; i++) {
-    DeepState_Input[i] = (char)rand();
-  }
+  /* Generate the input lazily, as the test reads it. Saving the test then
+   * generates the rest of it from the same state. */
+  uint64_t test_seed = DeepState_FuzzNumTests++;
+  DeepState_InputGenState =
+      DeepState_FuzzSeed ^ DeepState_SplitMix64(&test_seed);
+  DeepState_InputGenerated = 0;
 
   DeepState_Begin(test);
 
@@ -1148,11 +2661,16 @@ enum DeepState_TestRunResult DeepState_FuzzOneTestCase(struct DeepState_TestInfo
   return result;
 }
 
-extern int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
-  if (Size > sizeof(DeepState_Input)) {
-    return 0; // Just ignore any too-big inputs
-  }
+/* State of the libFuzzer entry point, which is set up once, either by
+ * `LLVMFuzzerInitialize` or by the first call to `LLVMFuzzerTestOneInput`. */
+static int DeepState_LibFuzzerInitialized = 0;
+static struct DeepState_TestInfo *DeepState_LibFuzzerTest = NULL;
+static int DeepState_LibFuzzerAbortOnFail = 0;
+static int DeepState_LibFuzzerExitOnFail = 0;
 
+/* Parse options, set up DeepState and find the test to run, once for all of
+ * the inputs that libFuzzer will give us. */
+static void DeepState_InitLibFuzzer(void) {
   DeepState_UsingLibFuzzer = 1;
 
   const char* loud = getenv("LIBFUZZER_LOUD");
@@ -1161,16 +2679,10 @@ extern int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
     DeepState_LibFuzzerLoud = 1;
   }
 
-  struct DeepState_TestInfo *test = NULL;
-
   DeepState_InitOptions(0, "");
   DeepState_Setup();
 
-  /* we also want to manually allocate CurrentTestRun */
-  void *mem = malloc(sizeof(struct DeepState_TestRunInfo));
-  DeepState_CurrentTestRun = (struct DeepState_TestRunInfo *) mem;
-
-  test = DeepState_FirstTest();
+  struct DeepState_TestInfo *test = DeepState_FirstTest();
   const char* which_test = getenv("LIBFUZZER_WHICH_TEST");
   if (which_test != NULL) {
     for (test = DeepState_FirstTest(); test != NULL; test = test->prev) {
@@ -1179,7 +2691,7 @@ extern int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
       }
     }
   }
-  
+
   if (test == NULL) {
     DeepState_LogFormat(DeepState_LogFatal,
                         "Could not find matching test for %s (from LIBFUZZER_WHICH_TEST)",
@@ -1187,35 +2699,72 @@ extern int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
     exit(255);
   }
 
-  DeepState_MemScrub((void *) DeepState_Input, sizeof(DeepState_Input));
+  DeepState_LibFuzzerTest = test;
+  DeepState_LibFuzzerAbortOnFail = getenv("LIBFUZZER_ABORT_ON_FAIL") != NULL;
+  DeepState_LibFuzzerExitOnFail = getenv("LIBFUZZER_EXIT_ON_FAIL") != NULL;
+  DeepState_LibFuzzerInitialized = 1;
+
+  /* libFuzzer never returns to us, so tear down when it exits. */
+  atexit(DeepState_Teardown);
+}
+
+#ifdef LIBFUZZER
+/* Called by libFuzzer once, before any input is run. This is weak so that a
+ * harness can still define its own. */
+__attribute__((weak))
+extern int LLVMFuzzerInitialize(int *argc, char ***argv) {
+  (void) argc;
+  (void) argv;
+  DeepState_InitLibFuzzer();
+  return 0;
+}
+#endif  /* LIBFUZZER */
+
+extern int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size) {
+  if (DEEPSTATE_UNLIKELY(!DeepState_LibFuzzerInitialized)) {
+    DeepState_InitLibFuzzer();
+  }
+
+  /* Grow the input buffer to fit, so that the fuzzer's `-max_len` decides
+   * how big inputs get. Inputs that can't fit are ignored. */
+  if (Size > DeepState_InputSize) {
+    if (Size > UINT32_MAX / 2) {
+      return 0;
+    }
+    DeepState_SetInputSize(Size > 2 * DeepState_InputSize ?
+                           (uint32_t) Size : 2 * DeepState_InputSize);
+    if (Size > DeepState_InputSize) {
+      return 0;
+    }
+  }
+
+  struct DeepState_TestInfo *test = DeepState_LibFuzzerTest;
+
   DeepState_InputIndex = 0;
+  DeepState_InputGenerated = DeepState_InputSize;
   DeepState_SwarmConfigsIndex = 0;
 
   memcpy((void *) DeepState_Input, (void *) Data, Size);
+  DeepState_ClearInputFrom(Size);
+  DeepState_SetInputEnd(Size);
 
   DeepState_Begin(test);
 
   enum DeepState_TestRunResult result = DeepState_RunTestNoFork(test);
   DeepState_CleanUp();
 
-  const char* abort_check = getenv("LIBFUZZER_ABORT_ON_FAIL");
-  if (abort_check != NULL) {
+  if (DeepState_LibFuzzerAbortOnFail) {
     if ((result == DeepState_TestRunFail) || (result == DeepState_TestRunCrash)) {
       assert(0); // Terminate the testing more permanently
     }
   }
 
-  const char* exit_check = getenv("LIBFUZZER_EXIT_ON_FAIL");
-  if (exit_check != NULL) {
+  if (DeepState_LibFuzzerExitOnFail) {
     if ((result == DeepState_TestRunFail) || (result == DeepState_TestRunCrash)) {
       exit(255); // Terminate the testing
     }
   }
 
-  DeepState_Teardown();
-  DeepState_CurrentTestRun = NULL;
-  free(mem);
-
   return 0;  // Non-zero return values are reserved for future use.
 }
 
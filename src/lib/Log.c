@@ -27,6 +27,8 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "deepstate/DeepState.h"
 #include "deepstate/Log.h"
@@ -68,22 +70,216 @@ enum {
   DeepState_LogBufSize = 4096
 };
 
-extern int DeepState_UsingLibFuzzer;
-extern int DeepState_LibFuzzerLoud;
-
 char DeepState_LogBuf[DeepState_LogBufSize + 1] = {};
 
+/* Number of bytes at the start of `DeepState_LogBuf` that may be non-zero. */
+static int DeepState_LogBufUsed = DeepState_LogBufSize;
+
+/* Write a message to stderr. The buffer is formatted in, and written out, in
+ * one go, so that messages from different processes don't interleave. */
+static void DeepState_LogWrite(enum DeepState_LogLevel level,
+                               const char *str) {
+  DeepState_MemScrub(DeepState_LogBuf, (size_t) DeepState_LogBufUsed);
+  int size = snprintf(DeepState_LogBuf, DeepState_LogBufSize, "%s: %s\n",
+                      DeepState_LogLevelStr(level), str);
+  DeepState_LogBufUsed = (size < 0 || size >= DeepState_LogBufSize) ?
+                         DeepState_LogBufSize : size + 1;
+  fputs(DeepState_LogBuf, stderr);
+}
+
+enum {
+  DeepState_LogRingSize = 1 << 16
+};
+
+/* Messages held back by `--defer_log`, oldest first. Each is a level byte
+ * and a two-byte length, followed by the text, without its NUL. The offsets
+ * only ever grow; they index the ring modulo its size. When the ring is
+ * full, the oldest messages are dropped.
+ *
+ * A process that forks tests keeps its ring in shared memory, so that it can
+ * write out the messages of a test that dies before it can do so itself. */
+struct DeepState_LogRing {
+  pid_t owner;       /* Process that shared the ring, if it is shared. */
+  int held;          /* Does the ring hold messages not yet written out? */
+  size_t begin;
+  size_t end;
+  unsigned dropped;
+  uint8_t data[DeepState_LogRingSize];
+};
+
+static struct DeepState_LogRing DeepState_PrivateLogRing = {};
+
+/* The ring that this process, and the tests it forks, hold messages in. */
+static struct DeepState_LogRing *DeepState_LogRing = &DeepState_PrivateLogRing;
+
+/* Are messages being held back for the current test? */
+static int DeepState_LogHeld = 0;
+
+static void DeepState_LogRingPut(struct DeepState_LogRing *ring,
+                                 const void *data, size_t size) {
+  size_t offset = ring->end % DeepState_LogRingSize;
+  size_t first = DeepState_LogRingSize - offset;
+  if (first > size) {
+    first = size;
+  }
+  memcpy(&(ring->data[offset]), data, first);
+  memcpy(ring->data, (const uint8_t *) data + first, size - first);
+  ring->end += size;
+}
+
+static void DeepState_LogRingGet(struct DeepState_LogRing *ring, size_t at,
+                                 void *data, size_t size) {
+  size_t offset = at % DeepState_LogRingSize;
+  size_t first = DeepState_LogRingSize - offset;
+  if (first > size) {
+    first = size;
+  }
+  memcpy(data, &(ring->data[offset]), first);
+  memcpy((uint8_t *) data + first, ring->data, size - first);
+}
+
+/* Hold back a message, rather than write it. */
+static void DeepState_LogDefer(enum DeepState_LogLevel level,
+                               const char *str) {
+  struct DeepState_LogRing *ring = DeepState_LogRing;
+  size_t len = strnlen(str, DeepState_LogBufSize);
+  uint8_t header[3] = {(uint8_t) level, (uint8_t) len, (uint8_t) (len >> 8)};
+
+  while (ring->end + sizeof(header) + len - ring->begin >
+         DeepState_LogRingSize) {
+    uint8_t oldest[3];
+    DeepState_LogRingGet(ring, ring->begin, oldest, sizeof(oldest));
+    ring->begin += sizeof(oldest) + (oldest[1] | ((size_t) oldest[2] << 8));
+    ring->dropped++;
+  }
+  DeepState_LogRingPut(ring, header, sizeof(header));
+  DeepState_LogRingPut(ring, str, len);
+}
+
+static void DeepState_LogRingClear(struct DeepState_LogRing *ring) {
+  ring->begin = ring->end = 0;
+  ring->dropped = 0;
+  ring->held = 0;
+}
+
+/* Write out the messages in `ring`, and empty it. */
+static void DeepState_LogRingWrite(struct DeepState_LogRing *ring) {
+  if (ring->dropped) {
+    char note[64];
+    snprintf(note, sizeof(note), "%u earlier messages were dropped",
+             ring->dropped);
+    DeepState_LogWrite(DeepState_LogWarning, note);
+  }
+  while (ring->begin != ring->end) {
+    uint8_t header[3];
+    char str[DeepState_LogBufSize + 1];
+    DeepState_LogRingGet(ring, ring->begin, header, sizeof(header));
+    size_t len = header[1] | ((size_t) header[2] << 8);
+    DeepState_LogRingGet(ring, ring->begin + sizeof(header), str, len);
+    str[len] = '\0';
+    ring->begin += sizeof(header) + len;
+    DeepState_LogWrite((enum DeepState_LogLevel) header[0], str);
+  }
+  DeepState_LogRingClear(ring);
+}
+
+/* Start holding back the messages of a test, if `--defer_log` is set. */
+void DeepState_HoldLog(void) {
+  DeepState_LogRingClear(DeepState_LogRing);
+  DeepState_LogHeld = FLAGS_defer_log && !DeepState_UsingSymExec;
+  DeepState_LogRing->held = DeepState_LogHeld;
+}
+
+/* Write out the messages held back so far, and stop holding them back. */
+void DeepState_FlushLog(void) {
+  if (!DeepState_LogHeld) {
+    return;
+  }
+  DeepState_LogHeld = 0;
+  DeepState_LogRingWrite(DeepState_LogRing);
+}
+
+/* Throw away the messages held back so far, and stop holding them back. */
+void DeepState_DropLog(void) {
+  DeepState_LogHeld = 0;
+  DeepState_LogRingClear(DeepState_LogRing);
+}
+
+/* Map a ring into memory that is shared with the processes forked from now
+ * on. Returns `NULL` if messages aren't held back, or if it can't be
+ * mapped. */
+struct DeepState_LogRing *DeepState_NewSharedLog(void) {
+  if (!FLAGS_defer_log || DeepState_UsingSymExec) {
+    return NULL;
+  }
+  void *mem = mmap(NULL, sizeof(struct DeepState_LogRing),
+                   PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+  if (mem == MAP_FAILED) {
+    return NULL;
+  }
+  return (struct DeepState_LogRing *) mem;
+}
+
+/* Unmap a ring from `DeepState_NewSharedLog`. */
+void DeepState_FreeSharedLog(struct DeepState_LogRing *ring) {
+  if (ring == DeepState_LogRing) {
+    DeepState_LogRing = &DeepState_PrivateLogRing;
+  }
+  if (ring != NULL) {
+    munmap(ring, sizeof(struct DeepState_LogRing));
+  }
+}
+
+/* Hold back the messages of this process, and of the tests it forks, in
+ * `ring`, or in a ring of its own if `ring` is `NULL`. */
+void DeepState_UseLog(struct DeepState_LogRing *ring) {
+  if (ring == NULL) {
+    ring = &DeepState_PrivateLogRing;
+  }
+  DeepState_LogHeld = 0;
+  DeepState_LogRingClear(ring);
+  ring->owner = getpid();
+  DeepState_LogRing = ring;
+}
+
+/* Make sure that the tests this process forks hold their messages in a ring
+ * that it shares with them. A forked worker gets a ring of its own, rather
+ * than writing to the one it inherited from its parent. */
+void DeepState_ShareLog(void) {
+  if (DeepState_LogRing != &DeepState_PrivateLogRing &&
+      DeepState_LogRing->owner == getpid()) {
+    return;
+  }
+  struct DeepState_LogRing *ring = DeepState_NewSharedLog();
+  if (ring != NULL) {
+    DeepState_UseLog(ring);
+  }
+}
+
+/* Write out the messages that a process holding them in `ring` (or in this
+ * process's ring, if `ring` is `NULL`) held back before it died. */
+void DeepState_FlushDeadLog(struct DeepState_LogRing *ring) {
+  if (ring == NULL) {
+    ring = DeepState_LogRing;
+  }
+  if (ring->held) {
+    DeepState_LogRingWrite(ring);
+  }
+}
+
 /* Log a C string. */
 DEEPSTATE_NOINLINE
 void DeepState_Log(enum DeepState_LogLevel level, const char *str) {
-  if ((DeepState_UsingLibFuzzer && !DeepState_LibFuzzerLoud && (level < DeepState_LogExternal)) ||
+  if (((int) level < DEEPSTATE_MIN_LOG_LEVEL && level < DeepState_LogError) ||
+      (DeepState_UsingLibFuzzer && !DeepState_LibFuzzerLoud && (level < DeepState_LogExternal)) ||
       (level < FLAGS_min_log_level)) {
     return;
   }
-  DeepState_MemScrub(DeepState_LogBuf, DeepState_LogBufSize);
-  snprintf(DeepState_LogBuf, DeepState_LogBufSize, "%s: %s\n",
-           DeepState_LogLevelStr(level), str);
-  fputs(DeepState_LogBuf, stderr);
+  if (DeepState_LogHeld) {
+    DeepState_LogDefer(level, str);
+  } else {
+    DeepState_LogWrite(level, str);
+  }
 
   if (DeepState_LogError == level) {
     DeepState_SoftFail();
@@ -101,7 +297,8 @@ void DeepState_LogVFormat(enum DeepState_LogLevel level,
                           const char *format, va_list args) {
   struct DeepState_VarArgs va;
   va_copy(va.args, args);
-  if (DeepState_UsingLibFuzzer && (level < DeepState_LogExternal)) {
+  if ((DeepState_UsingLibFuzzer && (level < DeepState_LogExternal)) ||
+      !DeepState_LogLevelEnabled(level)) {
     return;
   }
   DeepState_LogStream(level);
@@ -148,6 +148,10 @@ static void CheckCapacity(struct DeepState_Stream *stream,
   if (0 > num_chars_to_add) {
     DeepState_Abandon("Can't add a negative number of characters to a stream.");
   } else if ((stream->size + num_chars_to_add) >= DeepState_StreamSize) {
+    /* Only the message itself is scrubbed when the stream is cleared, so
+     * scrub what was written past it now. */
+    DeepState_MemScrub(&(stream->message[stream->size]),
+                       DeepState_StreamSize - stream->size);
     DeepState_Abandon("Exceeded capacity of stream buffer.");
   }
 }
@@ -276,7 +280,7 @@ void DeepState_StreamDouble(enum DeepState_LogLevel level, double val) {
 void DeepState_ClearStream(enum DeepState_LogLevel level) {
   struct DeepState_Stream *stream = &(DeepState_Streams[level]);
   if (stream->size) {
-    DeepState_MemScrub(stream->message, DeepState_StreamSize);
+    DeepState_MemScrub(stream->message, (size_t) stream->size + 1);
     stream->size = 0;
   }
 }
@@ -298,6 +302,16 @@ void DeepState_StreamResetFormatting(enum DeepState_LogLevel level) {
   DeepState_MemScrub(&(stream->options), sizeof(stream->options));
 }
 
+/* Clear the contents and formatting of every stream. A test that is
+ * interrupted part way through streaming a message can leave data behind,
+ * which must not leak into the next test run in the same process. */
+void DeepState_ResetStreams(void) {
+  for (int level = 0; level <= DeepState_LogFatal; ++level) {
+    DeepState_ClearStream((enum DeepState_LogLevel) level);
+    DeepState_StreamResetFormatting((enum DeepState_LogLevel) level);
+  }
+}
+
 static int DeepState_NumLsInt64BitFormat = 2;
 
 /* `PRId64` will be "ld" or "lld" */
@@ -630,4 +644,21 @@ void DeepState_StreamFormat(enum DeepState_LogLevel level,
   va_end(args);
 }
 
+/* Stream the location of a message in the source, as `file(line): `. This
+ * is formatted in one go, rather than through `DeepState_StreamVFormat`,
+ * except for symbolic executors, which only see the hooked streamers. */
+void DeepState_StreamLocation(enum DeepState_LogLevel level,
+                              const char *file, unsigned line) {
+  if (DeepState_UsingSymExec) {
+    DeepState_StreamFormat(level, "%s(%u): ", file, line);
+    return;
+  }
+  struct DeepState_Stream *stream = &(DeepState_Streams[level]);
+  int remaining_size = DeepState_StreamSize - stream->size;
+  int size = snprintf(&(stream->message[stream->size]),
+                      remaining_size, "%s(%u): ", file, line);
+  CheckCapacity(stream, size);
+  stream->size += size;
+}
+
 DEEPSTATE_END_EXTERN_C
@@ -31,3 +31,11 @@ class DeepStateFuzzerTestCase(TestCase):
 
   def run_deepstate(self, deepstate):
     raise NotImplementedError("Define an actual test of DeepState in DeepStateFuzzerTestCase:run_deepstate.")
+
+
+class DeepStateNativeTestCase(TestCase):
+  def test_native(self):
+    self.run_native()
+
+  def run_native(self):
+    raise NotImplementedError("Define an actual test of a DeepState harness in DeepStateNativeTestCase:run_native.")
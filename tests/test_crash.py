@@ -1,6 +1,9 @@
 from __future__ import print_function
+import os
+import struct
 import deepstate_base
 import logrun
+from tempfile import TemporaryDirectory
 
 
 class CrashTest(deepstate_base.DeepStateTestCase):
@@ -16,3 +19,42 @@ class CrashTest(deepstate_base.DeepStateTestCase):
         foundCrashSave = True
     self.assertTrue(foundCrashSave)
 
+
+
+class CrashForkServerTest(deepstate_base.DeepStateNativeTestCase):
+  def run_native(self):
+    with TemporaryDirectory(prefix="deepstate_test_crash_") as in_dir:
+      for i in range(4):
+        with open(os.path.join(in_dir, "input{}.pass".format(i)), "wb") as f:
+          f.write(struct.pack(">I", i))
+      with open(os.path.join(in_dir, "segfault.crash"), "wb") as f:
+        f.write(struct.pack(">I", 0x1234))
+
+      # Tests forked by the fork server crash like any other.
+      (r, output) = logrun.logrun(
+        ["build/examples/Crash", "--input_test_files_dir", in_dir,
+         "--fork_server"],
+        "deepstate.out", 60)
+      self.assertNotEqual(r, "TIMEOUT")
+      self.assertTrue("segfault.crash crashed" in output)
+      self.assertEqual(output.count("Passed: Crash_SegFault"), 4)
+      self.assertFalse("fork server" in output)
+
+
+class CrashDeferLogTest(deepstate_base.DeepStateNativeTestCase):
+  def run_native(self):
+    with TemporaryDirectory(prefix="deepstate_test_crash_") as in_dir:
+      with open(os.path.join(in_dir, "segfault.crash"), "wb") as f:
+        f.write(struct.pack(">I", 0x1234))
+
+      # A crashing test never gets to write out the log it held back, so the
+      # process that ran it does.
+      for extra in [[], ["--fork_server"], ["--num_workers", "2"],
+                    ["--num_workers", "2", "--persistent_replay", "2"]]:
+        (r, output) = logrun.logrun(
+          ["build/examples/Crash", "--input_test_files_dir", in_dir,
+           "--defer_log", "--verbose_reads"] + extra,
+          "deepstate.out", 60)
+        self.assertNotEqual(r, "TIMEOUT")
+        self.assertTrue("segfault.crash crashed" in output)
+        self.assertTrue("FINISHED MULTI-BYTE READ" in output)
@@ -0,0 +1,66 @@
+from __future__ import print_function
+import os
+import re
+import struct
+import logrun
+import deepstate_base
+from tempfile import TemporaryDirectory
+
+
+class GeneratorsTest(deepstate_base.DeepStateNativeTestCase):
+  def run_native(self):
+    for harness in ["build/examples/Generators", "build/examples/Generators17"]:
+      tests = ["Generators_Program", "Generators_Tuple", "Generators_Tree"]
+      if harness.endswith("17"):
+        tests.append("Generators_OptionalVariant")
+      for test in tests:
+        self.fuzz_and_replay(harness, test)
+      self.replay_known_inputs(harness)
+
+  def replay_known_inputs(self, harness):
+    # Inputs of big-endian 32-bit values (64 bits for sizes), and the values
+    # they must produce, checking the order in which generators draw.
+    known = [
+      ("Generators_Program", struct.pack(">q4i", 2, 0, 6, 2, 7),
+       "program: add 6 mul 7"),
+      ("Generators_Tuple", struct.pack(">4i", 9, 2, 3, 0),
+       "tuple: 9 99 9 0"),
+      ("Generators_Tree", struct.pack(">9i", 3, 2, 0, 1, 1, 1, 2, 0, 0),
+       "tree: (3 (0 (1 (2))) (0))"),
+    ]
+    with TemporaryDirectory(prefix="deepstate_test_generators_") as in_dir:
+      for (test, data, message) in known:
+        path = os.path.join(in_dir, test + ".fail")
+        with open(path, "wb") as f:
+          f.write(data)
+        (r, output) = logrun.logrun(
+          [harness, "--input_test_file", path, "--input_which_test", test,
+           "--min_log_level", "2"],
+          "deepstate.out", 60)
+        self.assertNotEqual(r, "TIMEOUT")
+        self.assertTrue(("): " + message + "\n") in output)
+
+  def fuzz_and_replay(self, harness, test):
+    with TemporaryDirectory(prefix="deepstate_test_generators_") as out_dir:
+      (r, output) = logrun.logrun(
+        [harness, "--fuzz", "--timeout", "3", "--input_which_test", test,
+         "--output_test_dir", out_dir, "--min_log_level", "2"],
+        "deepstate.out", 60)
+      self.assertTrue("Done fuzzing!" in output)
+
+      # Pair each failure message with the file its test was saved in.
+      failures = re.findall(r"^CRITICAL: [^\n]*\): ([^\n]*)\n"
+                            r"ERROR: Failed: [^\n]*\n"
+                            r"INFO: Saved test case in file `([^`]*)`",
+                            output, re.MULTILINE)
+      self.assertTrue(len(failures) > 0)
+
+      # Replaying a saved test must draw the very same values.
+      for (message, saved) in failures[:5]:
+        (r, output) = logrun.logrun(
+          [harness, "--input_test_file", saved, "--input_which_test", test,
+           "--min_log_level", "2"],
+          "deepstate.out", 60)
+        self.assertNotEqual(r, "TIMEOUT")
+        self.assertTrue(("): " + message + "\n") in output)
+        self.assertTrue("Failed: " + test in output)
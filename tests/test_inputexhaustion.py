@@ -0,0 +1,46 @@
+from __future__ import print_function
+import os
+import re
+import logrun
+import deepstate_base
+from tempfile import TemporaryDirectory
+
+
+class InputExhaustionTest(deepstate_base.DeepStateNativeTestCase):
+  def run_native(self):
+    with TemporaryDirectory(prefix="deepstate_test_inputexhaustion_") as in_dir:
+      short = os.path.join(in_dir, "short.pass")
+      with open(short, "wb") as f:
+        f.write(b"\x00\x00\x00\x07")
+      other = os.path.join(in_dir, "other.pass")
+      with open(other, "wb") as f:
+        f.write(b"\x00\x00\x00\x08")
+
+      def replay(path, mode):
+        (r, output) = logrun.logrun(
+          ["build/examples/InputExhaustion", "--input_test_file", path,
+           "--input_exhaustion", mode, "--min_log_level", "2"],
+          "deepstate.out", 60)
+        self.assertNotEqual(r, "TIMEOUT")
+        return output
+
+      def summary(output):
+        m = re.search(r"first (\d+), (\d+) nonzero, checksum (\d+)", output)
+        self.assertTrue(m is not None)
+        return (int(m.group(1)), int(m.group(2)), int(m.group(3)))
+
+      # The test reads past the end of the input buffer, which abandons it.
+      output = replay(short, "abandon")
+      self.assertTrue("Abandoned: InputExhaustion_ReadPastTheEnd" in output)
+
+      # Past the end of the file, and of the buffer, are zeros.
+      output = replay(short, "zero")
+      self.assertEqual(summary(output)[:2], (7, 1))
+
+      # The input is extended with generated bytes after its own, the same
+      # way every time it is replayed, and differently for another input.
+      first = summary(replay(short, "extend"))
+      self.assertEqual(first[0], 7)
+      self.assertTrue(first[1] > 1)
+      self.assertEqual(summary(replay(short, "extend")), first)
+      self.assertNotEqual(summary(replay(other, "extend"))[2], first[2])
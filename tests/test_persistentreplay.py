@@ -0,0 +1,30 @@
+from __future__ import print_function
+import os
+import struct
+import logrun
+import deepstate_base
+from tempfile import TemporaryDirectory
+
+
+class PersistentReplayTest(deepstate_base.DeepStateNativeTestCase):
+  def run_native(self):
+    with TemporaryDirectory(prefix="deepstate_test_persistentreplay_") as in_dir:
+      # Passing inputs, and the input that makes Crash_SegFault crash.
+      for i in range(8):
+        with open(os.path.join(in_dir, "input{}.pass".format(i)), "wb") as f:
+          f.write(struct.pack(">I", i))
+      with open(os.path.join(in_dir, "segfault.crash"), "wb") as f:
+        f.write(struct.pack(">I", 0x1234))
+
+      for extra_args in [[], ["--num_workers", "2"]]:
+        (r, output) = logrun.logrun(
+          ["build/examples/Crash", "--input_test_files_dir", in_dir,
+           "--persistent_replay", "4"] + extra_args,
+          "deepstate.out", 60)
+        self.assertNotEqual(r, "TIMEOUT")
+
+        # The crash is reported, and the inputs queued after it still run,
+        # in a fresh process.
+        self.assertTrue("segfault.crash crashed" in output)
+        self.assertEqual(output.count("Passed: Crash_SegFault"), 8)
+        self.assertTrue("Ran 9 tests; 1 tests failed" in output)
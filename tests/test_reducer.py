@@ -0,0 +1,71 @@
+from __future__ import print_function
+import os
+import struct
+import subprocess
+import logrun
+import deepstate_base
+from tempfile import TemporaryDirectory
+from deepstate.executors.auxiliary import reducer
+
+
+# An input for the OneOf example that starts at -2147483618, then doubles
+# (wrapping to 60) and adds 10, failing the assertion after the second OneOf.
+FAILING = struct.pack(">3I", 0x8000001E, 2, 3)
+
+
+class ReducerTest(deepstate_base.DeepStateNativeTestCase):
+  def run_native(self):
+    with TemporaryDirectory(prefix="deepstate_test_reducer_") as work_dir:
+      self.check_trace(work_dir)
+      self.check_reduce(work_dir)
+
+  def check_trace(self, work_dir):
+    test = os.path.join(work_dir, "oneof.fail")
+    with open(test, "wb") as f:
+      f.write(FAILING)
+    trace = os.path.join(work_dir, "oneof.trace")
+    (r, output) = logrun.logrun(
+      ["build/examples/OneOf", "--input_test_file", test,
+       "--trace_reads", trace],
+      "deepstate.out", 60)
+    self.assertTrue("Failed: OneOfExample_ProduceSixtyOrHigher" in output)
+
+    # The file is exactly a header and `capacity` entries, as the reducer
+    # unpacks them; a change to either struct in DeepState.h breaks this.
+    with open(trace, "rb") as f:
+      data = f.read()
+    (magic, capacity, count) = reducer.TRACE_HEADER.unpack_from(data, 0)
+    self.assertEqual(magic, reducer.TRACE_MAGIC)
+    self.assertEqual(len(data),
+                     reducer.TRACE_HEADER.size +
+                     capacity * reducer.TRACE_ENTRY.size)
+
+    self.assertEqual(reducer.readTrace(trace), [
+      (reducer.TRACE_READ, 0, 4, 0),
+      (reducer.TRACE_ONEOF_BEGIN, 4, 0, 0),
+      (reducer.TRACE_READ, 4, 4, 0),
+      (reducer.TRACE_ONEOF_END, 8, 0, 0),
+      (reducer.TRACE_ONEOF_BEGIN, 8, 0, 0),
+      (reducer.TRACE_READ, 8, 4, 0),
+      (reducer.TRACE_ONEOF_END, 12, 0, 0)])
+
+  def check_reduce(self, work_dir):
+    # Pad the failing input with a third choice and bytes it never reads,
+    # which the reducer should find it can drop.
+    test = os.path.join(work_dir, "padded.fail")
+    with open(test, "wb") as f:
+      f.write(FAILING + struct.pack(">I", 4) + b"\xff" * 20)
+    reduced = os.path.join(work_dir, "reduced.fail")
+    # The reducer is not a harness, so it doesn't take logrun's extra flags.
+    # It keeps its candidates in the directory it runs in.
+    r = subprocess.call(
+      ["deepstate-reduce", os.path.abspath("build/examples/OneOf"), test,
+       reduced, "--timeout", "300"],
+      cwd=work_dir)
+    self.assertEqual(r, 0)
+    self.assertTrue(os.path.getsize(reduced) <= len(FAILING))
+
+    (r, output) = logrun.logrun(
+      ["build/examples/OneOf", "--input_test_file", reduced],
+      "deepstate.out", 60)
+    self.assertTrue("Failed: OneOfExample_ProduceSixtyOrHigher" in output)
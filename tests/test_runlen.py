@@ -1,4 +1,5 @@
 from __future__ import print_function
+import psutil
 import deepstate_base
 import logrun
 
@@ -18,3 +19,35 @@ class RunlenTest(deepstate_base.DeepStateTestCase):
         foundFailSave = True
     self.assertTrue(foundFailSave)
 
+
+
+class RunlenForkServerTest(deepstate_base.DeepStateNativeTestCase):
+  def run_native(self):
+    cmd = ["build/examples/Runlen", "--fuzz", "--fork_server", "--timeout", "4",
+           "--input_which_test", "Runlength_EncodeDecode", "--min_log_level", "2"]
+
+    (r, output) = logrun.logrun(cmd, "deepstate.out", 60)
+    self.assertTrue("Done fuzzing!" in output)
+    self.assertTrue(("Saved test case" in output) and (".fail" in output))
+    self.assertFalse("fork server" in output)
+
+    # Kill the fork server while fuzzing. The harness runs tests without it
+    # until it starts a new one, and keeps fuzzing.
+    killed = []
+    def kill_fork_server(new_output):
+      if not killed:
+        for harness in psutil.Process().children():
+          for server in harness.children():
+            try:
+              server.kill()
+              killed.append(server.pid)
+            except psutil.NoSuchProcess:
+              pass
+      return False
+
+    (r, output) = logrun.logrun(cmd, "deepstate.out", 60,
+                                break_callback=kill_fork_server)
+    self.assertTrue(len(killed) > 0)
+    self.assertTrue(("Lost contact with the fork server" in output) or
+                    ("The fork server exited" in output))
+    self.assertTrue("Done fuzzing!" in output)